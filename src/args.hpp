@@ -35,6 +35,7 @@ class Args
 	Option getOpt(const std::string &) const;
 	bool optExists(const std::string &) const;
 	bool optExists(const std::string &, const std::string &) const;
+	std::string getValue(const std::string &, const std::string & = "") const;
 	std::string getName() const;
 	void convert();
 };
@@ -99,6 +100,17 @@ bool Args::optExists(const std::string &option1, const std::string &option2) con
 	return (options.find(option1) != options.end() ||
 			options.find(option2) != options.end());
 }
+
+// The value of a --option=value, or the fallback if it wasn't given
+std::string Args::getValue(const std::string &option, const std::string &fallback) const
+{
+	const std::string prefix(option + '=');
+	for(const auto &item: options)
+		if(item.first.compare(0U, prefix.size(), prefix) == 0)
+			return item.first.substr(prefix.size());
+	return fallback;
+}
+
 std::string Args::getName() const { return name; }
 
 void Args::convert()
@@ -0,0 +1,262 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+// --cache, the collected table of a directory kept in $XDG_CACHE_HOME/list, one file per
+// directory named after its device and inode. A file is only used while the directory's mtime
+// and ctime are what they were when it was written, i.e. nothing was added, removed or renamed
+// since. Changes to the entries themselves (a file growing) don't touch the directory, so their
+// sizes and times can be stale, that's the trade off. Every entry and all of its metadata is
+// stored, whatever the listing that wrote it showed, so any later listing can use it
+
+#include "meta.hpp"
+#include "table.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <vector>
+
+// What a cached table has for every entry
+constexpr unsigned int CACHE_MASK = META_LONG | STATX_BLOCKS;
+
+struct CacheHeader
+{
+	char magic[8];
+	uint32_t meta_size;	   // sizeof(FileMeta), so a file from another build is never misread
+	uint32_t count;
+	uint64_t dev, ino, names_size;
+	int64_t mtime, ctime;
+	uint32_t mtime_nsec, ctime_nsec;
+};
+// Followed by FileMeta[count], uint8_t types[count], uint8_t lengths[count] and the names back
+// to back
+
+constexpr char CACHE_MAGIC[8] = {'l', 'i', 's', 't', 'c', 'a', 'c', '1'};
+
+// The directory's identity and times, false if they can't be had
+inline bool cacheKey(const int dirfd, CacheHeader& key)
+{
+	struct statx stx;
+	if(statx(dirfd, "", AT_EMPTY_PATH, STATX_INO | STATX_MTIME | STATX_CTIME, &stx) != 0)
+		return false;
+	std::memset(&key, 0, sizeof(key));
+	std::memcpy(key.magic, CACHE_MAGIC, sizeof(key.magic));
+	key.meta_size = sizeof(FileMeta);
+	key.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+	key.ino = stx.stx_ino;
+	key.mtime = stx.stx_mtime.tv_sec;
+	key.mtime_nsec = stx.stx_mtime.tv_nsec;
+	key.ctime = stx.stx_ctime.tv_sec;
+	key.ctime_nsec = stx.stx_ctime.tv_nsec;
+	return true;
+}
+
+// The last few tables --serve has read, checked the same way as the files and in front of them
+class WarmTables
+{
+private:
+	struct Slot
+	{
+		CacheHeader key;
+		EntryTable table;
+		uint64_t used;
+	};
+	const size_t capacity;
+	std::vector<Slot> slots;
+	uint64_t clock;
+
+public:
+	explicit WarmTables(const size_t count) : capacity(count), clock(0U) {}
+
+	const EntryTable* find(const CacheHeader& key)
+	{
+		for(Slot& slot: slots)
+			if(std::memcmp(&slot.key, &key, sizeof(key)) == 0)
+			{
+				slot.used = ++clock;
+				return &slot.table;
+			}
+		return nullptr;
+	}
+
+	// Replaces the table of the same directory, or the least recently used one
+	void store(const CacheHeader& key, const EntryTable& table)
+	{
+		Slot* slot = nullptr;
+		for(Slot& candidate: slots)
+			if(candidate.key.dev == key.dev && candidate.key.ino == key.ino)
+				slot = &candidate;
+		if(!slot && slots.size() < capacity)
+			slot = &slots.emplace_back();
+		if(!slot)
+			slot = &*std::min_element(slots.begin(), slots.end(), [](const Slot& a, const Slot& b) {
+				return a.used < b.used;
+			});
+		slot->key = key;
+		slot->table = table;
+		slot->used = ++clock;
+	}
+};
+
+// Only set while serving
+inline WarmTables* warm_tables = nullptr;
+
+// $XDG_CACHE_HOME/list, or ~/.cache/list
+inline std::string cacheDirectory()
+{
+	const char* xdg = std::getenv("XDG_CACHE_HOME");
+	const char* home = std::getenv("HOME");
+	if(xdg && *xdg == '/')
+		return std::string(xdg) + "/list";
+	return home && *home ? std::string(home) + "/.cache/list" : std::string();
+}
+
+inline std::string cachePath(const CacheHeader& key)
+{
+	char name[40];
+	snprintf(name,
+			 sizeof(name),
+			 "/%llx-%llx",
+			 static_cast<unsigned long long>(key.dev),
+			 static_cast<unsigned long long>(key.ino));
+	return cacheDirectory() + name;
+}
+
+// The entries of `from` that are listed, dotfiles only with `show_all`
+inline void copyEntries(const EntryTable& from, EntryTable& to, const bool show_all)
+{
+	for(size_t i = 0U; i < from.size(); ++i)
+		if(show_all || from.name(i)[0] != '.')
+		{
+			to.add(from.name(i), from.type(i));
+			to.setMeta(to.size() - 1U, from.meta(i));
+		}
+}
+
+// The entries of a cache file that are listed
+inline void readEntries(const char* data, const CacheHeader& header, EntryTable& table,
+						const bool show_all)
+{
+	const char* metas = data + sizeof(header);
+	const uint8_t* types =
+		reinterpret_cast<const uint8_t*>(metas + header.count * sizeof(FileMeta));
+	const uint8_t* lengths = types + header.count;
+	const char* name = reinterpret_cast<const char*>(lengths + header.count);
+	table.reserve(header.count, header.names_size);
+	for(uint32_t i = 0U; i < header.count; name += lengths[i++])
+		if(show_all || name[0] != '.')
+		{
+			FileMeta meta;
+			std::memcpy(&meta, metas + i * sizeof(FileMeta), sizeof(FileMeta));
+			table.add(std::string_view(name, lengths[i]), types[i]);
+			table.setMeta(table.size() - 1U, meta);
+		}
+}
+
+// Fills `table` from the cache if there's a valid one for the directory, leaving out dotfiles
+// unless `show_all`
+inline bool loadCache(const int dirfd, EntryTable& table, const bool show_all)
+{
+	CacheHeader key;
+	if(!cacheKey(dirfd, key))
+		return false;
+	if(const EntryTable* warm = warm_tables ? warm_tables->find(key) : nullptr)
+	{
+		copyEntries(*warm, table, show_all);
+		return true;
+	}
+	if(cacheDirectory().empty())
+		return false;
+	const int fd = open(cachePath(key).c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return false;
+	struct stat info;
+	void* map = fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(CacheHeader)
+					? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+					: MAP_FAILED;
+	close(fd);
+	if(map == MAP_FAILED)
+		return false;
+
+	const char* data = static_cast<const char*>(map);
+	CacheHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	const size_t expected =
+		sizeof(header) + header.count * (sizeof(FileMeta) + 2U) + size_t(header.names_size);
+	const bool valid = std::memcmp(&header, &key, offsetof(CacheHeader, count)) == 0 &&
+					   header.dev == key.dev && header.ino == key.ino &&
+					   header.mtime == key.mtime && header.mtime_nsec == key.mtime_nsec &&
+					   header.ctime == key.ctime && header.ctime_nsec == key.ctime_nsec &&
+					   expected == size_t(info.st_size);
+	if(valid && warm_tables)
+	{
+		EntryTable everything;
+		readEntries(data, header, everything, true);
+		copyEntries(everything, table, show_all);
+		warm_tables->store(key, everything);
+	}
+	else if(valid)
+		readEntries(data, header, table, show_all);
+	munmap(map, info.st_size);
+	return valid;
+}
+
+// Writes `table` (every entry, with CACHE_MASK metadata) as the cache of the directory. Skipped
+// when the directory changed within a second of `read_at`, a change in the same timestamp tick
+// as the cache would otherwise go unnoticed
+inline void storeCache(const int dirfd, const EntryTable& table, const std::time_t read_at)
+{
+	CacheHeader header;
+	const std::string directory = cacheDirectory();
+	if(!cacheKey(dirfd, header) || header.ctime >= read_at - 1 || header.mtime >= read_at - 1)
+		return;
+	if(warm_tables)
+		warm_tables->store(header, table);
+	if(directory.empty())
+		return;
+	header.count = table.size();
+	header.names_size = 0U;
+	for(size_t i = 0U; i < table.size(); ++i)
+		header.names_size += table.name(i).size();
+
+	std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+	for(size_t i = 0U; i < table.size(); ++i)
+		data.append(reinterpret_cast<const char*>(&table.meta(i)), sizeof(FileMeta));
+	for(size_t i = 0U; i < table.size(); ++i)
+		data.push_back(char(table.type(i)));
+	for(size_t i = 0U; i < table.size(); ++i)
+		data.push_back(char(table.name(i).size()));
+	for(size_t i = 0U; i < table.size(); ++i)
+		data.append(table.name(i));
+
+	// Written next to it and renamed over it, readers never see half a file
+	const size_t slash = directory.rfind('/');
+	mkdir(directory.substr(0U, slash).c_str(), 0700);
+	mkdir(directory.c_str(), 0700);
+	std::string temporary = directory + "/.tmp.XXXXXX";
+	const int fd = mkostemp(temporary.data(), O_CLOEXEC);
+	if(fd < 0)
+		return;
+	bool written = true;
+	for(size_t done = 0U; done < data.size() && written;)
+	{
+		const ssize_t result = write(fd, data.data() + done, data.size() - done);
+		written = result > 0 || (result < 0 && errno == EINTR);
+		done += result > 0 ? result : 0;
+	}
+	close(fd);
+	if(!written || rename(temporary.c_str(), cachePath(header).c_str()) != 0)
+		unlink(temporary.c_str());
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef DU_HPP
+#define DU_HPP
+
+// --du, recursive totals for the directories of a listing. Every directory underneath is a task
+// on a StealingPool, read with getdents and sized with one fstatat per entry, and adds what it
+// found to the total of the listed directory it's under. A total is done once every directory
+// under it is, so the listing can print each line as soon as its directory is totalled.
+// Files with more than one link are counted once per run, through a (dev, inode) set
+
+#include "pool.hpp"
+#include "scan.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class DuWalker
+{
+public:
+	struct Total
+	{
+		std::atomic<uint64_t> apparent {0U}, allocated {0U};	// st_size and st_blocks * 512
+		std::atomic<size_t> pending {1U};						// Directories not read yet
+	};
+
+private:
+	// A directory descriptor shared by the subdirectory tasks that still have to openat() it
+	struct Handle
+	{
+		int fd;
+		std::atomic<unsigned int>* count;
+		~Handle()
+		{
+			if(fd >= 0)
+				close(fd);
+			--*count;
+		}
+	};
+
+	struct Task
+	{
+		Total* total = nullptr;
+		std::shared_ptr<Handle> parent;	   // Open it relative to this when there is one
+		std::string path, name;			   // The whole path, and the name in `parent`
+	};
+
+	struct Inode
+	{
+		uint64_t dev, ino;
+		bool operator==(const Inode& other) const { return dev == other.dev && ino == other.ino; }
+	};
+	struct InodeHash
+	{
+		size_t operator()(const Inode& inode) const
+		{
+			return (inode.ino * 0x9E3779B97F4A7C15ULL) ^ inode.dev;
+		}
+	};
+	// Sharded so the threads rarely wait on each other for it
+	struct Seen
+	{
+		std::mutex lock;
+		std::unordered_set<Inode, InodeHash> inodes;
+	};
+	static constexpr size_t SHARDS = 64U;
+
+	const std::string top_path;
+	const bool one_filesystem;
+	const unsigned int max_handles;
+	dev_t device;
+	std::atomic<unsigned int> handles;
+	std::unique_ptr<Seen[]> seen;
+	std::unordered_map<uint32_t, std::unique_ptr<Total>> totals;
+	std::shared_ptr<Handle> top;	// The listed directory, until start()
+	std::mutex done_lock;
+	std::condition_variable done;
+	StealingPool<Task> pool;
+
+	// False if the (dev, inode) pair was already counted
+	bool firstLink(const struct stat& info)
+	{
+		const Inode inode {uint64_t(info.st_dev), uint64_t(info.st_ino)};
+		Seen& shard = seen[(InodeHash()(inode) >> 32U) % SHARDS];
+		std::lock_guard<std::mutex> guard(shard.lock);
+		return shard.inodes.insert(inode).second;
+	}
+
+	void finish(Total& total)
+	{
+		if(--total.pending == 0U)
+		{
+			std::lock_guard<std::mutex> guard(done_lock);
+			done.notify_all();
+		}
+	}
+
+	void visit(Task& task, const unsigned int worker)
+	{
+		DirScanner scanner(task.parent ? task.parent->fd : AT_FDCWD,
+						   task.parent ? task.name : task.path,
+						   32U * 1024U);
+		task.parent.reset();
+		struct stat info;
+		if(!scanner.good() || fstat(scanner.dirfd(), &info) != 0 ||
+		   (one_filesystem && info.st_dev != device))
+		{
+			finish(*task.total);
+			return;
+		}
+
+		uint64_t apparent = info.st_size, allocated = info.st_blocks * 512ULL;
+		std::vector<std::string> children;
+		while(scanner.batch([&](const RawEntry* entry) {
+			if(entry->d_type == DT_DIR)
+				children.emplace_back(entry->d_name);
+			else if(fstatat(scanner.dirfd(), entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0)
+			{
+				if(S_ISDIR(info.st_mode))
+					children.emplace_back(entry->d_name);
+				else if(info.st_nlink <= 1U || firstLink(info))
+				{
+					apparent += info.st_size;
+					allocated += info.st_blocks * 512ULL;
+				}
+			}
+		}))
+			;
+		task.total->apparent += apparent;
+		task.total->allocated += allocated;
+
+		task.total->pending += children.size();
+		std::shared_ptr<Handle> self;
+		if(!children.empty() && handles++ < max_handles)
+			self.reset(new Handle {scanner.release(), &handles});
+		else if(!children.empty())
+			--handles;
+		for(std::string& name: children)
+		{
+			Task child;
+			child.total = task.total;
+			child.parent = self;
+			child.path = task.path + '/' + name;
+			child.name = std::move(name);
+			pool.push(worker, std::move(child));
+		}
+		finish(*task.total);
+	}
+
+public:
+	// `dirfd` is the listed directory, the walker works on its own copy of it
+	DuWalker(const int dirfd, const std::string& path, const unsigned int jobs,
+			 const bool same_filesystem, const unsigned int handle_limit) :
+		top_path(path),
+		one_filesystem(same_filesystem),
+		max_handles(handle_limit),
+		device(0),
+		handles(0U),
+		seen(new Seen[SHARDS]),
+		pool(jobs)
+	{
+		struct stat info;
+		if(fstat(dirfd, &info) == 0)
+			device = info.st_dev;
+		// Without a copy of `dirfd` the top level is opened by its whole path
+		if(const int copy = fcntl(dirfd, F_DUPFD_CLOEXEC, 0); copy >= 0)
+		{
+			++handles;
+			top.reset(new Handle {copy, &handles});
+		}
+	}
+	DuWalker(const DuWalker&) = delete;
+	DuWalker& operator=(const DuWalker&) = delete;
+	~DuWalker() { pool.join(); }
+
+	// Queues the subdirectory `name` of the listed directory as entry `entry`, before start()
+	void add(const uint32_t entry, const std::string_view name)
+	{
+		Total* total = (totals[entry] = std::unique_ptr<Total>(new Total)).get();
+		Task task;
+		task.total = total;
+		task.path = top_path + '/' + std::string(name);
+		task.name = name;
+		task.parent = top;
+		pool.push(entry, std::move(task));
+	}
+
+	void start()
+	{
+		top.reset();
+		pool.start([this](Task& task, const unsigned int worker) { visit(task, worker); });
+	}
+
+	// Whether `entry`'s total is in (or it was never added), wait() won't block
+	bool ready(const uint32_t entry) const
+	{
+		const auto found = totals.find(entry);
+		return found == totals.end() || found->second->pending == 0U;
+	}
+
+	// Nullptr if `entry` wasn't added, otherwise blocks until its total is in
+	const Total* wait(const uint32_t entry)
+	{
+		const auto found = totals.find(entry);
+		if(found == totals.end())
+			return nullptr;
+		std::unique_lock<std::mutex> lock(done_lock);
+		done.wait(lock, [&]() { return found->second->pending == 0U; });
+		return found->second.get();
+	}
+};
+
+#endif
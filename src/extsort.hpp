@@ -0,0 +1,275 @@
+#ifndef EXTSORT_HPP
+#define EXTSORT_HPP
+
+// Sorted listings that don't fit in --mem-limit. The table is filled until it reaches the
+// limit, then sorted, written to a temporary file as one run and emptied for the next part of
+// the directory. Once the directory is read the runs are merged back together while printing,
+// each read through a small window, so memory stays around the limit plus a window per run.
+// A record is the name, its type and (when there is any) its metadata, the sort key is rebuilt
+// from those when it's read back so the merge orders exactly like SortKeys does
+
+#include "meta.hpp"
+#include "sortkey.hpp"
+#include "table.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <malloc.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+// "64M", "1G", "512K" or plain bytes, 0 if it isn't a size
+inline size_t parseSize(const std::string& text)
+{
+	char* end = nullptr;
+	const unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+	if(end == text.c_str())
+		return 0U;
+	switch(*end)
+	{
+		case '\0':
+			return value;
+		case 'k':
+		case 'K':
+			return value << 10U;
+		case 'm':
+		case 'M':
+			return value << 20U;
+		case 'g':
+		case 'G':
+			return value << 30U;
+		default:
+			return 0U;
+	}
+}
+
+class RunFile
+{
+private:
+	// Name length and d_type in front of every record
+	static constexpr size_t HEADER = 2U;
+	// The biggest record there can be
+	static constexpr size_t RECORD_MAX = HEADER + sizeof(FileMeta) + 255U;
+	// Records are written out once this much is pending
+	static constexpr size_t WRITE_SIZE = 1024U * 1024U;
+
+	struct Run
+	{
+		uint64_t offset, size;
+		bool with_meta;
+	};
+
+	// The next record of a run while merging
+	struct Head
+	{
+		const Run* run;
+		uint64_t read;	  // Bytes of the run read into the window so far
+		std::unique_ptr<char[]> window;
+		size_t used, filled;
+		std::string name, folded;
+		unsigned char type;
+		FileMeta meta;
+		SortKey key;
+	};
+
+	const SortMode mode;
+	const bool reverse;
+	int fd;
+	uint64_t end;
+	std::vector<Run> runs;
+	std::string pending;	// Records not written yet
+	bool failed;
+
+	bool flush()
+	{
+		for(size_t done = 0U; done < pending.size() && !failed;)
+		{
+			const ssize_t written = pwrite(fd, pending.data() + done, pending.size() - done, end);
+			if(written < 0 && errno == EINTR)
+				continue;
+			failed = written <= 0;
+			if(!failed)
+			{
+				done += written;
+				end += written;
+			}
+		}
+		pending.clear();
+		return !failed;
+	}
+
+	// Reads the next record of `head` into it, false once the run is done
+	bool advance(Head& head, const size_t window_size)
+	{
+		if(head.filled - head.used < RECORD_MAX && head.read < head.run->size)
+		{
+			std::memmove(head.window.get(), head.window.get() + head.used, head.filled - head.used);
+			head.filled -= head.used;
+			head.used = 0U;
+			const size_t want = std::min<uint64_t>(window_size - head.filled, head.run->size - head.read);
+			for(size_t done = 0U; done < want;)
+			{
+				const ssize_t got =
+					pread(fd, head.window.get() + head.filled, want - done, head.run->offset + head.read);
+				if(got < 0 && errno == EINTR)
+					continue;
+				if(got <= 0)
+				{
+					failed = true;
+					return false;
+				}
+				done += got;
+				head.filled += got;
+				head.read += got;
+			}
+		}
+		if(head.used >= head.filled)
+			return false;
+
+		const char* record = head.window.get() + head.used;
+		const uint8_t length = record[0];
+		head.type = record[1];
+		record += HEADER;
+		if(head.run->with_meta)
+		{
+			std::memcpy(&head.meta, record, sizeof(FileMeta));
+			record += sizeof(FileMeta);
+		}
+		head.name.assign(record, length);
+		head.used = record + length - head.window.get();
+
+		head.folded.resize(length);
+		for(size_t i = 0U; i < length; ++i)
+			head.folded[i] = foldCase(head.name[i]);
+		fillKey(head.key, mode, head.name, head.folded.data(), head.type == DT_DIR, head.meta);
+		return true;
+	}
+
+public:
+	// The file is unlinked from the start, it's gone as soon as it's closed
+	RunFile(const SortMode sort_mode, const bool reversed) :
+		mode(sort_mode), reverse(reversed), fd(-1), end(0U), failed(false)
+	{
+		// glibc raises its mmap threshold to the size of a big block once it's freed, after which
+		// every run's sort keys and metadata come from the heap and the holes they leave stay
+		// resident (-l with 1M entries went 5M over a 16M limit). Pinned, blocks that big are
+		// always mapped on their own and handed back when they're freed
+		mallopt(M_MMAP_THRESHOLD, 128 * 1024);
+		const char* env = std::getenv("TMPDIR");
+		const std::string dir = env && *env ? env : "/tmp";
+		fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_EXCL | O_CLOEXEC, 0600);
+		if(fd < 0)
+		{
+			// Filesystems without O_TMPFILE
+			std::string path = dir + "/list.XXXXXX";
+			fd = mkostemp(path.data(), O_CLOEXEC);
+			if(fd >= 0)
+				unlink(path.c_str());
+		}
+		failed = fd < 0;
+	}
+	RunFile(const RunFile&) = delete;
+	RunFile& operator=(const RunFile&) = delete;
+	~RunFile()
+	{
+		if(fd >= 0)
+			close(fd);
+	}
+
+	bool good() const { return !failed; }
+	bool empty() const { return runs.empty(); }
+
+	// Sorts the table and appends it as a new run, false if it couldn't be written
+	bool spill(const EntryTable& table)
+	{
+		if(failed || table.empty())
+			return !failed;
+
+		const std::vector<uint32_t> order = sortTable(table, mode, reverse);
+		runs.push_back({end, 0U, table.hasMeta()});
+		pending.reserve(WRITE_SIZE + RECORD_MAX);
+		for(const uint32_t i: order)
+		{
+			const std::string_view name = table.name(i);
+			pending.push_back(char(name.size()));
+			pending.push_back(char(table.type(i)));
+			if(table.hasMeta())
+				pending.append(reinterpret_cast<const char*>(&table.meta(i)), sizeof(FileMeta));
+			pending.append(name);
+			if(pending.size() >= WRITE_SIZE && !flush())
+				return false;
+		}
+		if(!flush())
+			return false;
+		runs.back().size = end - runs.back().offset;
+		return true;
+	}
+
+	// Merges the runs, handing them to `fn(batch)` in order a table of up to `batch_size`
+	// entries at a time. False if a run couldn't be read back
+	template<typename Fn>
+	bool merge(Fn&& fn, const size_t window_size = 64U * 1024U, const size_t batch_size = 4096U)
+	{
+		std::vector<Head> heads(runs.size());
+		std::vector<uint32_t> heap;
+		for(uint32_t i = 0U; i < runs.size(); ++i)
+		{
+			heads[i].run = &runs[i];
+			heads[i].read = 0U;
+			heads[i].window.reset(new char[window_size]);
+			heads[i].used = heads[i].filled = 0U;
+			heads[i].key.index = i;
+			if(advance(heads[i], window_size))
+				heap.push_back(i);
+		}
+
+		// Whichever should be printed later. Equal keys come out in run order, which is the order
+		// they were read in, the same as SortKeys keeps them in without --mem-limit
+		auto original = [&](const SortKey& key) { return heads[key.index].name.c_str(); };
+		auto later = [&](const uint32_t a, const uint32_t b) {
+			const Head &first = heads[a], &second = heads[b];
+			const int order = entryCompare(mode,
+										   reverse,
+										   first.key,
+										   first.folded.data(),
+										   second.key,
+										   second.folded.data(),
+										   original);
+			return order != 0 ? order > 0 : b < a;
+		};
+		std::make_heap(heap.begin(), heap.end(), later);
+
+		EntryTable batch;
+		batch.reserve(batch_size);
+		while(!heap.empty())
+		{
+			std::pop_heap(heap.begin(), heap.end(), later);
+			Head& head = heads[heap.back()];
+			batch.add(head.name, head.type);
+			if(head.run->with_meta)
+				batch.setMeta(batch.size() - 1U, head.meta);
+			if(advance(head, window_size))
+				std::push_heap(heap.begin(), heap.end(), later);
+			else
+				heap.pop_back();
+
+			if(batch.size() == batch_size)
+			{
+				fn(batch);
+				batch.clear();
+			}
+		}
+		if(!batch.empty())
+			fn(batch);
+		return !failed;
+	}
+};
+
+#endif
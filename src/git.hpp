@@ -0,0 +1,547 @@
+#ifndef GIT_HPP
+#define GIT_HPP
+
+// --git, a status marker for every entry straight from .git/index, without git or libgit2.
+// The index is mmapped and its (sorted) paths binary searched for the listed names. An entry
+// whose mode, size, mtime and inode still match what the index cached is unchanged, like git
+// itself decides, one whose type or size changed is modified. Only the rest (touched but maybe
+// not changed, or written in the same second as the index) have their contents hashed, on
+// --jobs threads. Names that aren't in the index are untracked, or ignored when a .gitignore
+// (or info/exclude, or the global one) says so.
+// Only the work tree is compared to the index, staged changes (index against HEAD) don't show
+
+#include "meta.hpp"
+#include "pool.hpp"
+#include "table.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+class Sha1
+{
+private:
+	uint32_t state[5];
+	uint64_t length;
+	uint8_t block[64];
+	size_t used;
+
+	static uint32_t rotate(const uint32_t value, const unsigned int bits)
+	{
+		return (value << bits) | (value >> (32U - bits));
+	}
+
+	void compress(const uint8_t* data)
+	{
+		uint32_t w[80];
+		for(unsigned int i = 0U; i < 16U; ++i)
+			w[i] = uint32_t(data[4U * i]) << 24U | uint32_t(data[4U * i + 1U]) << 16U |
+				   uint32_t(data[4U * i + 2U]) << 8U | uint32_t(data[4U * i + 3U]);
+		for(unsigned int i = 16U; i < 80U; ++i)
+			w[i] = rotate(w[i - 3U] ^ w[i - 8U] ^ w[i - 14U] ^ w[i - 16U], 1U);
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+		for(unsigned int i = 0U; i < 80U; ++i)
+		{
+			const uint32_t f = i < 20U   ? ((b & c) | (~b & d)) + 0x5A827999U
+							   : i < 40U ? (b ^ c ^ d) + 0x6ED9EBA1U
+							   : i < 60U ? ((b & c) | (b & d) | (c & d)) + 0x8F1BBCDCU
+										 : (b ^ c ^ d) + 0xCA62C1D6U;
+			const uint32_t next = rotate(a, 5U) + f + e + w[i];
+			e = d;
+			d = c;
+			c = rotate(b, 30U);
+			b = a;
+			a = next;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+
+public:
+	Sha1() :
+		state {0x67452301U, 0xEFCDAB89U, 0x98BADCFEU, 0x10325476U, 0xC3D2E1F0U}, length(0U), used(0U)
+	{
+	}
+
+	void update(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		length += size;
+		if(used > 0U)
+		{
+			const size_t take = std::min(size, 64U - used);
+			std::memcpy(block + used, bytes, take);
+			used += take;
+			bytes += take;
+			size -= take;
+			if(used < 64U)
+				return;
+			compress(block);
+			used = 0U;
+		}
+		for(; size >= 64U; bytes += 64U, size -= 64U)
+			compress(bytes);
+		std::memcpy(block, bytes, size);
+		used = size;
+	}
+
+	void digest(uint8_t out[20])
+	{
+		const uint64_t bits = length * 8U;
+		const uint8_t one = 0x80U, zero = 0U;
+		update(&one, 1U);
+		while(used != 56U)
+			update(&zero, 1U);
+		uint8_t size[8];
+		for(unsigned int i = 0U; i < 8U; ++i)
+			size[i] = bits >> (56U - 8U * i);
+		update(size, 8U);
+		for(unsigned int i = 0U; i < 20U; ++i)
+			out[i] = state[i / 4U] >> (24U - 8U * (i % 4U));
+	}
+};
+
+inline uint32_t bigEndian32(const char* data)
+{
+	uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return __builtin_bswap32(value);
+}
+
+inline uint16_t bigEndian16(const char* data)
+{
+	uint16_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return __builtin_bswap16(value);
+}
+
+// The whole file, empty if it can't be read
+inline std::string readFile(const std::string& path)
+{
+	std::string contents;
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return contents;
+	char buffer[4096];
+	ssize_t got;
+	while((got = read(fd, buffer, sizeof(buffer))) > 0)
+		contents.append(buffer, got);
+	close(fd);
+	return contents;
+}
+
+// .git/index, versions 2 to 4
+class GitIndex
+{
+public:
+	// What the index remembers about a file, the stat fields cut to 32 bits like git does
+	struct Entry
+	{
+		uint32_t mtime, mtime_nsec, ino, mode, size;
+		const uint8_t* hash;
+		uint16_t flags, extended;
+		unsigned int stage() const { return (flags >> 12U) & 3U; }
+		// Assume unchanged (update-index --assume-unchanged) or skip worktree (sparse checkout)
+		bool trusted() const { return (flags & 0x8000U) || (extended & 0x4000U); }
+	};
+
+private:
+	void* map;
+	size_t size;
+	size_t hash_size;
+	std::vector<uint32_t> entries;	  // Where each entry starts
+	std::vector<std::string_view> paths;
+	std::string names;	  // Version 4 compresses paths against the previous one, spelled out here
+	timespec written;
+
+	bool parse()
+	{
+		const char* data = static_cast<const char*>(map);
+		if(size < 12U + hash_size || std::memcmp(data, "DIRC", 4U) != 0)
+			return false;
+		const uint32_t version = bigEndian32(data + 4U), count = bigEndian32(data + 8U);
+		if(version < 2U || version > 4U)
+			return false;
+
+		// 40 bytes of stat data, the hash and the flags, then the path
+		const size_t fixed = 40U + hash_size + 2U;
+		const char* end = data + size - hash_size;
+		std::vector<std::pair<uint32_t, uint32_t>> spans;
+		std::string previous;
+		size_t at = 12U;
+		entries.reserve(count);
+		for(uint32_t k = 0U; k < count; ++k)
+		{
+			if(data + at + fixed + 2U > end)
+				return false;
+			const uint16_t flags = bigEndian16(data + at + fixed - 2U);
+			const char* name = data + at + fixed + (version >= 3U && (flags & 0x4000U) ? 2U : 0U);
+			entries.push_back(at);
+			if(version == 4U)
+			{
+				// How much of the previous path to drop, git's offset varint
+				size_t strip = *name & 127U;
+				while(*name & 128U && name + 1 < end)
+					strip = ((strip + 1U) << 7U) | (*++name & 127U);
+				++name;
+				const char* nul = static_cast<const char*>(std::memchr(name, '\0', end - name));
+				if(!nul || strip > previous.size())
+					return false;
+				previous.resize(previous.size() - strip);
+				previous.append(name, nul);
+				spans.emplace_back(names.size(), previous.size());
+				names.append(previous);
+				at = nul + 1 - data;
+			}
+			else
+			{
+				size_t length = flags & 0xFFFU;
+				if(length == 0xFFFU)
+				{
+					const char* nul = static_cast<const char*>(std::memchr(name, '\0', end - name));
+					length = nul ? nul - name : end - name;
+				}
+				paths.emplace_back(name, length);
+				// Padded with NULs to a multiple of 8
+				at += ((name - (data + at)) + length + 8U) & ~size_t(7U);
+			}
+		}
+		for(const auto& [offset, length]: spans)
+			paths.emplace_back(names.data() + offset, length);
+		return true;
+	}
+
+public:
+	// `hash_length` is 20 for SHA-1 repositories and 32 for SHA-256 ones
+	GitIndex(const std::string& path, const size_t hash_length) :
+		map(MAP_FAILED), size(0U), hash_size(hash_length), written {}
+	{
+		const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0)
+			return;
+		struct stat info;
+		if(fstat(fd, &info) == 0 && info.st_size > 0)
+		{
+			size = info.st_size;
+			written = info.st_mtim;
+			map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+		if(map != MAP_FAILED && !parse())
+		{
+			entries.clear();
+			paths.clear();
+		}
+	}
+	GitIndex(const GitIndex&) = delete;
+	GitIndex& operator=(const GitIndex&) = delete;
+	~GitIndex()
+	{
+		if(map != MAP_FAILED)
+			munmap(map, size);
+	}
+
+	// The first (lowest stage) entry for `path`, -1 if it isn't in the index
+	long find(const std::string_view path) const
+	{
+		const auto found = std::lower_bound(paths.begin(), paths.end(), path);
+		return found != paths.end() && *found == path ? found - paths.begin() : -1;
+	}
+
+	// Whether anything under `directory` (with its trailing '/') is in the index
+	bool contains(const std::string_view directory) const
+	{
+		const auto found = std::lower_bound(paths.begin(), paths.end(), directory);
+		return found != paths.end() && found->substr(0U, directory.size()) == directory;
+	}
+
+	Entry entry(const size_t k) const
+	{
+		const char* data = static_cast<const char*>(map) + entries[k];
+		Entry entry;
+		entry.mtime = bigEndian32(data + 8U);
+		entry.mtime_nsec = bigEndian32(data + 12U);
+		entry.ino = bigEndian32(data + 20U);
+		entry.mode = bigEndian32(data + 24U);
+		entry.size = bigEndian32(data + 36U);
+		entry.hash = reinterpret_cast<const uint8_t*>(data + 40U);
+		entry.flags = bigEndian16(data + 40U + hash_size);
+		entry.extended = entry.flags & 0x4000U ? bigEndian16(data + 42U + hash_size) : 0U;
+		return entry;
+	}
+
+	// Changed in the same tick the index was written, its stat data can't be trusted
+	bool racy(const Entry& entry) const
+	{
+		return entry.mtime > uint32_t(written.tv_sec) ||
+			   (entry.mtime == uint32_t(written.tv_sec) && entry.mtime_nsec >= written.tv_nsec);
+	}
+};
+
+// The exclude rules that apply to the listed directory, from the global excludes file,
+// info/exclude and every .gitignore from the top of the work tree down to it
+class GitIgnore
+{
+private:
+	struct Pattern
+	{
+		std::string glob, base;	   // `base` is the directory of its .gitignore, "dir/"
+		bool negate, dir_only, anchored;
+	};
+	std::vector<Pattern> patterns;
+	bool inside_ignored;	// The listed directory is in an ignored one, as is all of it
+
+	void load(const std::string& path, const std::string& base)
+	{
+		const std::string file = readFile(path);
+		for(size_t begin = 0U, end; begin < file.size(); begin = end + 1U)
+		{
+			end = std::min(file.find('\n', begin), file.size());
+			std::string line = file.substr(begin, end - begin);
+			while(!line.empty() && (line.back() == '\r' || line.back() == ' ') &&
+				  !(line.size() > 1U && line[line.size() - 2U] == '\\'))
+				line.pop_back();
+			if(line.empty() || line[0] == '#')
+				continue;
+
+			Pattern pattern {std::string(), base, line[0] == '!', false, false};
+			if(pattern.negate || (line[0] == '\\' && line.size() > 1U))
+				line.erase(0U, 1U);
+			pattern.dir_only = line.size() > 1U && line.back() == '/';
+			if(pattern.dir_only)
+				line.pop_back();
+			pattern.anchored = line.find('/') != std::string::npos;
+			if(line[0] == '/')
+				line.erase(0U, 1U);
+			pattern.glob = std::move(line);
+			patterns.push_back(std::move(pattern));
+		}
+	}
+
+	// 1 ignored, 0 a negation matched last, -1 nothing matched
+	int match(const std::string& path, const bool dir) const
+	{
+		const size_t slash = path.rfind('/');
+		const char* name = path.c_str() + (slash == std::string::npos ? 0U : slash + 1U);
+		int result = -1;
+		for(const Pattern& pattern: patterns)
+		{
+			if(pattern.dir_only && !dir)
+				continue;
+			bool matched;
+			if(pattern.anchored)
+				// "**" has to be able to cross directories, fnmatch can only do that for all of '*'
+				matched = path.compare(0U, pattern.base.size(), pattern.base) == 0 &&
+						  fnmatch(pattern.glob.c_str(),
+								  path.c_str() + pattern.base.size(),
+								  pattern.glob.find("**") == std::string::npos ? FNM_PATHNAME : 0) ==
+							  0;
+			else
+				matched = fnmatch(pattern.glob.c_str(), name, 0) == 0;
+			if(matched)
+				result = pattern.negate ? 0 : 1;
+		}
+		return result;
+	}
+
+public:
+	// `prefix` is where the listed directory is in the work tree, "" or "some/dir/"
+	GitIgnore(const std::string& root, const std::string& git_dir, const std::string& prefix) :
+		inside_ignored(false)
+	{
+		const char* config = std::getenv("XDG_CONFIG_HOME");
+		const char* home = std::getenv("HOME");
+		if(config && *config == '/')
+			load(std::string(config) + "/git/ignore", "");
+		else if(home && *home)
+			load(std::string(home) + "/.config/git/ignore", "");
+		load(git_dir + "/info/exclude", "");
+		load(root + "/.gitignore", "");
+		for(size_t slash = prefix.find('/'); slash != std::string::npos;
+			slash = prefix.find('/', slash + 1U))
+		{
+			const std::string directory = prefix.substr(0U, slash);
+			inside_ignored = inside_ignored || match(directory, true) == 1;
+			load(root + '/' + directory + "/.gitignore", directory + '/');
+		}
+	}
+
+	bool ignored(const std::string& path, const bool dir) const
+	{
+		return inside_ignored || match(path, dir) == 1;
+	}
+};
+
+// The work tree `directory` is in, its top, git directory and where in it `directory` is ("" or
+// "some/dir/"). False outside of one, or inside the git directory itself
+inline bool findRepository(const std::string& directory, std::string& root, std::string& git_dir,
+						   std::string& prefix)
+{
+	char resolved[PATH_MAX];
+	if(!realpath(directory.c_str(), resolved))
+		return false;
+	const std::string path(resolved);
+	for(root = path;; root.resize(std::max<size_t>(root.rfind('/'), 1U)))
+	{
+		const std::string dot_git = (root == "/" ? std::string() : root) + "/.git";
+		struct stat info;
+		if(stat(dot_git.c_str(), &info) == 0)
+		{
+			git_dir = dot_git;
+			// Worktrees and submodules have a "gitdir: <path>" file instead
+			if(S_ISREG(info.st_mode))
+			{
+				const std::string file = readFile(dot_git);
+				if(file.compare(0U, 8U, "gitdir: ") != 0)
+					return false;
+				git_dir = file.substr(8U, file.find_first_of("\r\n") - 8U);
+				if(git_dir[0] != '/')
+					git_dir = root + '/' + git_dir;
+			}
+			break;
+		}
+		if(root == "/")
+			return false;
+	}
+	prefix = path.size() > root.size() ? path.substr(root == "/" ? 1U : root.size() + 1U) + '/'
+										: std::string();
+	return prefix.compare(0U, 5U, ".git/") != 0;
+}
+
+// Whether the file (or symlink) `name` has the contents of the blob `hash`
+inline bool sameBlob(const int dirfd, const char* name, const bool link, const uint8_t* hash)
+{
+	Sha1 sha;
+	char header[32];
+	if(link)
+	{
+		char target[PATH_MAX];
+		const ssize_t length = readlinkat(dirfd, name, target, sizeof(target));
+		if(length < 0)
+			return false;
+		sha.update(header, snprintf(header, sizeof(header), "blob %zd", length) + 1U);
+		sha.update(target, length);
+	}
+	else
+	{
+		const int fd = openat(dirfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		struct stat info;
+		if(fd < 0 || fstat(fd, &info) != 0)
+		{
+			if(fd >= 0)
+				close(fd);
+			return false;
+		}
+		sha.update(header,
+				   snprintf(header, sizeof(header), "blob %llu", static_cast<unsigned long long>(info.st_size)) + 1U);
+		std::unique_ptr<char[]> buffer(new char[64U * 1024U]);
+		ssize_t got;
+		off_t total = 0;
+		while((got = read(fd, buffer.get(), 64U * 1024U)) > 0)
+		{
+			sha.update(buffer.get(), got);
+			total += got;
+		}
+		close(fd);
+		if(got < 0 || total != info.st_size)
+			return false;
+	}
+	uint8_t digest[20];
+	sha.digest(digest);
+	return std::memcmp(digest, hash, sizeof(digest)) == 0;
+}
+
+// ' ' while the stat data still matches the index, 'M' when the contents can't be the same
+// anymore, '\0' when only hashing them can tell
+inline char compareStat(const GitIndex& index, const GitIndex::Entry& entry, const FileMeta& meta)
+{
+	const uint32_t type = entry.mode & S_IFMT;
+	// Submodules aren't looked into
+	if(entry.trusted() || type == 0160000U)
+		return ' ';
+	if(type != (meta.mode & S_IFMT) || (type == S_IFREG && ((entry.mode ^ meta.mode) & S_IXUSR)))
+		return 'M';
+	// The size of a link (its target's length) isn't in FileMeta, there are few of them
+	if(type == S_IFLNK)
+		return '\0';
+	// A size of 0 is git "smudging" a racily clean entry, the contents have to be looked at
+	if(entry.size != uint32_t(meta.size))
+		return entry.size == 0U ? '\0' : 'M';
+	return entry.mtime == uint32_t(meta.mtime) && entry.mtime_nsec == meta.mtime_nsec &&
+				   entry.ino == uint32_t(meta.ino) && !index.racy(entry)
+			   ? ' '
+			   : '\0';
+}
+
+// Needed from the metadata pass to compare against the index
+constexpr unsigned int GIT_MASK = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME;
+
+// Gives every entry of `table` (the listing of `directory`, with GIT_MASK metadata) its
+// status: ' ' unchanged, 'M' modified, 'U' unmerged, '?' untracked, '!' ignored. Nothing
+// outside of a work tree
+inline void gitStatus(EntryTable& table, const std::string& directory, const int dirfd,
+					  const unsigned int jobs)
+{
+	std::string root, git_dir, prefix;
+	if(table.empty() || !findRepository(directory, root, git_dir, prefix))
+		return;
+	// extensions.objectformat = sha256
+	const std::string config = readFile(git_dir + "/config");
+	const size_t format = config.find("objectformat");
+	const size_t value = format == std::string::npos
+							 ? std::string::npos
+							 : config.find_first_not_of(" \t=", format + 12U);
+	const bool sha256 = value != std::string::npos && config.compare(value, 6U, "sha256") == 0;
+	const GitIndex index(git_dir + "/index", sha256 ? 32U : 20U);
+	const GitIgnore ignore(root, git_dir, prefix);
+
+	std::vector<std::pair<uint32_t, GitIndex::Entry>> unsure;
+	std::string path(prefix);
+	for(uint32_t i = 0U; i < table.size(); ++i)
+	{
+		path.resize(prefix.size());
+		path.append(table.name(i));
+		char status;
+		if(const long k = index.find(path); k >= 0)
+		{
+			const GitIndex::Entry entry = index.entry(k);
+			status = entry.stage() != 0U ? 'U' : compareStat(index, entry, table.meta(i));
+			if(status == '\0')
+				unsure.emplace_back(i, entry);
+		}
+		else if(table.isDir(i) && index.contains(path + '/'))
+			status = ' ';
+		else
+			status = ignore.ignored(path, table.isDir(i)) ? '!' : '?';
+		table.setStatus(i, status);
+	}
+
+	// SHA-256 isn't implemented, what can't be told from the stat data counts as modified
+	parallelChunks(jobs, unsure.size(), 8U, [&](const size_t begin, const size_t end) {
+		for(size_t k = begin; k < end; ++k)
+		{
+			const auto& [i, entry] = unsure[k];
+			const bool same =
+				!sha256 && sameBlob(dirfd, table.cName(i), S_ISLNK(table.meta(i).mode), entry.hash);
+			table.setStatus(i, same ? ' ' : 'M');
+		}
+	});
+}
+
+#endif
@@ -1,10 +1,13 @@
-#include <unordered_map>
-
-// FIXME: This can just be a C style array or std::array with std::string_views
+#include <string_view>
+#include <utility>
 
 // TODO: add Downloads maybe an arrow? *.tup and Tupfile please!
 
-const static std::unordered_map<std::string, std::string> icons = {
+// Keys are either a whole file name or whatever comes after one of its dots, so multi-dot
+// suffixes like "tar.gz" work too. icons.hpp turns this into a perfect hash table at compile
+// time, so keys have to be unique
+
+constexpr std::pair<std::string_view, std::string_view> icon_list[] = {
 	// Peki <3
 	{"Peki", "\uf004 "},
 	{"peki", "\uf004 "},
@@ -63,6 +66,7 @@ const static std::unordered_map<std::string, std::string> icons = {
 	{"src", "\uf121 "},
 	{"tags", "\uf02b "},
 	{"ts", "\ue628 "},
+	{"d.ts", "\ue628 "},
 	{"tup", "\ue615 "},
 	{"vscode", "\ufb0f "},
 	{"wine", "\uf7a7 "},
@@ -177,6 +181,9 @@ const static std::unordered_map<std::string, std::string> icons = {
 	{"rar", "\ufac3"},
 	{"rpm", "\uf316 "},
 	{"tar", "\uf1c6 "},
+	{"tar.bz2", "\uf1c6 "},
+	{"tar.gz", "\uf1c6 "},
+	{"tar.xz", "\uf1c6 "},
 	{"tgz", "\uf1c6 "},
 	{"z", "\uf1c6 "},
 	{"zip", "\uf1c6 "},
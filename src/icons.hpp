@@ -0,0 +1,98 @@
+#ifndef ICONS_HPP
+#define ICONS_HPP
+
+// Perfect hash over the keys in icons.cpp, built by the compiler. A seed is searched for that
+// puts every key in its own slot, so a lookup is one hash, one probe and one compare, and
+// there's nothing to set up at startup
+
+#include "icons.cpp"
+#include "width.hpp"
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+constexpr uint32_t iconHash(const std::string_view key, const uint32_t seed)
+{
+	// FNV-1a with a final mix so the low bits are usable as a slot
+	uint32_t hash = 2166136261U ^ seed;
+	for(const char letter: key)
+	{
+		hash ^= static_cast<uint8_t>(letter);
+		hash *= 16777619U;
+	}
+	hash ^= hash >> 15U;
+	hash *= 0x2c1b3c6dU;
+	hash ^= hash >> 12U;
+	return hash;
+}
+
+constexpr size_t ICON_COUNT = std::size(icon_list);
+// Power of two, ~20 slots per key so a collision free seed turns up after a few dozen tries
+constexpr size_t ICON_SLOTS = 4096U;
+constexpr uint16_t NO_ICON = 0xFFFFU;
+static_assert(ICON_COUNT < NO_ICON, "Too many icons for 16 bit slots");
+
+struct IconTable
+{
+	uint32_t seed;
+	std::array<uint16_t, ICON_SLOTS> slots;
+};
+
+constexpr IconTable makeIconTable()
+{
+	IconTable table {};
+	for(table.seed = 0U; table.seed < 100000U; ++table.seed)
+	{
+		table.slots.fill(NO_ICON);
+		bool collision = false;
+		for(size_t i = 0U; i < ICON_COUNT && !collision; ++i)
+		{
+			uint16_t& slot = table.slots[iconHash(icon_list[i].first, table.seed) & (ICON_SLOTS - 1U)];
+			collision = slot != NO_ICON;
+			slot = i;
+		}
+		if(!collision)
+			return table;
+	}
+	return table;
+}
+
+constexpr IconTable icon_table = makeIconTable();
+static_assert(icon_table.seed < 100000U, "No perfect hash found, are there duplicate icon keys?");
+
+// Index into icon_list for an exact key, NO_ICON if there isn't one
+constexpr uint16_t lookupIcon(const std::string_view key)
+{
+	const uint16_t slot = icon_table.slots[iconHash(key, icon_table.seed) & (ICON_SLOTS - 1U)];
+	return (slot != NO_ICON && icon_list[slot].first == key) ? slot : NO_ICON;
+}
+
+// The whole name first, then every suffix after a '.', longest first
+constexpr uint16_t findIcon(const std::string_view name)
+{
+	uint16_t icon = lookupIcon(name);
+	for(size_t dot = name.find('.'); icon == NO_ICON && dot != std::string_view::npos;
+		dot = name.find('.', dot + 1U))
+		icon = lookupIcon(name.substr(dot + 1U));
+	return icon;
+}
+
+static_assert(findIcon("Makefile") != NO_ICON && findIcon("archive.tar.gz") == lookupIcon("tar.gz"));
+
+// Columns each icon takes, mostly a glyph and a space but some are a single wide glyph
+constexpr std::array<uint8_t, ICON_COUNT> icon_widths = [] {
+	std::array<uint8_t, ICON_COUNT> widths {};
+	for(size_t i = 0U; i < ICON_COUNT; ++i)
+		widths[i] = decodedWidth(icon_list[i].second);
+	return widths;
+}();
+
+// The same for an entry's icon, the default ones are both a glyph and a space
+constexpr size_t iconWidth(const uint16_t icon)
+{
+	return icon == NO_ICON ? 2U : icon_widths[icon];
+}
+
+#endif
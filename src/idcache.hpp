@@ -0,0 +1,101 @@
+#ifndef IDCACHE_HPP
+#define IDCACHE_HPP
+
+// uid/gid -> name, every distinct id is looked up once per run. getpwuid()/getgrgid() can end
+// up asking sssd/LDAP, so with `files` the names come straight out of /etc/passwd and
+// /etc/group instead, and NSS is never loaded
+
+#include <cstdint>
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+class IdCache
+{
+private:
+	const bool use_files;
+	std::unordered_map<uint32_t, std::string> users, groups;
+
+	// Reads every `name:password:id:...` line of an /etc/passwd style file into `names`
+	static void parseFile(const char* path, std::unordered_map<uint32_t, std::string>& names)
+	{
+		const int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if(fd < 0)
+			return;
+		struct stat info;
+		if(fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			close(fd);
+			return;
+		}
+		void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(map == MAP_FAILED)
+			return;
+
+		std::string_view file(static_cast<const char*>(map), info.st_size);
+		while(!file.empty())
+		{
+			const size_t end = file.find('\n');
+			std::string_view line(file.substr(0U, end));
+			file.remove_prefix(end == std::string_view::npos ? file.size() : end + 1U);
+
+			const size_t name_end = line.find(':');
+			const size_t id_begin = line.find(':', name_end + 1U);
+			if(name_end == std::string_view::npos || name_end == 0U ||
+			   id_begin == std::string_view::npos || line.front() == '#')
+				continue;
+
+			uint32_t id = 0U;
+			size_t i = id_begin + 1U;
+			for(; i < line.size() && line[i] >= '0' && line[i] <= '9'; ++i)
+				id = id * 10U + (line[i] - '0');
+			if(i == id_begin + 1U)
+				continue;
+			// Like NSS, the first entry for an id wins
+			names.emplace(id, std::string(line.substr(0U, name_end)));
+		}
+		munmap(map, info.st_size);
+	}
+
+public:
+	explicit IdCache(const bool files = false) : use_files(files)
+	{
+		if(use_files)
+		{
+			parseFile("/etc/passwd", users);
+			parseFile("/etc/group", groups);
+		}
+	}
+
+	// Ids without a name show up as the number, like ls does
+	const std::string& user(const uint32_t uid)
+	{
+		auto found = users.find(uid);
+		if(found == users.end())
+		{
+			const struct passwd* pw = use_files ? nullptr : getpwuid(uid);
+			found = users.emplace(uid, pw ? std::string(pw->pw_name) : std::to_string(uid)).first;
+		}
+		return found->second;
+	}
+
+	const std::string& group(const uint32_t gid)
+	{
+		auto found = groups.find(gid);
+		if(found == groups.end())
+		{
+			const struct group* gr = use_files ? nullptr : getgrgid(gid);
+			found = groups.emplace(gid, gr ? std::string(gr->gr_name) : std::to_string(gid)).first;
+		}
+		return found->second;
+	}
+};
+
+#endif
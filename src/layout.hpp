@@ -0,0 +1,112 @@
+#ifndef LAYOUT_HPP
+#define LAYOUT_HPP
+
+// The grid, entries down the first column then the next like ls does, every column only as wide
+// as its own widest entry so one long name doesn't spread all of them out. The densest grid is
+// the one with the most columns that still fits the terminal. A column is a contiguous range of
+// the listing, so its width is a range maximum: the entries are split into blocks of 16 with
+// prefix and suffix maxima inside each block and a sparse table over the blocks' maxima, which
+// answers any range in constant time. Trying a column count then costs as much as it has
+// columns, and with at most a few hundred of them every count is tried, from the most down.
+// Whether a grid fits isn't monotone in its column count (an odd long name can land in a column
+// of its own with one count and share with another), so a binary search could miss the densest
+// one. Setting up is linear in the entries plus n/16 log n for the sparse table
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class RangeMax
+{
+private:
+	static constexpr size_t BLOCK = 16U;
+	std::vector<uint16_t> values, prefix, suffix;
+	std::vector<std::vector<uint16_t>> blocks;	  // [l][b], the largest of 2^l blocks from b
+
+	uint16_t blockMax(const size_t first, const size_t last) const
+	{
+		const size_t level = 63U - __builtin_clzll(last - first);
+		return std::max(blocks[level][first], blocks[level][last - (size_t(1U) << level)]);
+	}
+
+public:
+	explicit RangeMax(std::vector<uint16_t> widths) : values(std::move(widths))
+	{
+		prefix.resize(values.size());
+		suffix.resize(values.size());
+		blocks.emplace_back((values.size() + BLOCK - 1U) / BLOCK);
+		for(size_t i = 0U; i < values.size(); ++i)
+			prefix[i] = i % BLOCK ? std::max(prefix[i - 1U], values[i]) : values[i];
+		for(size_t i = values.size(); i-- > 0U;)
+		{
+			const bool same_block = (i + 1U) % BLOCK && i + 1U < values.size();
+			suffix[i] = same_block ? std::max(suffix[i + 1U], values[i]) : values[i];
+			if(i % BLOCK == 0U)
+				blocks[0U][i / BLOCK] = suffix[i];
+		}
+		for(size_t span = 2U; span <= blocks[0U].size(); span *= 2U)
+		{
+			const std::vector<uint16_t>& below = blocks.back();
+			std::vector<uint16_t> level(below.size() - span / 2U);
+			for(size_t b = 0U; b < level.size(); ++b)
+				level[b] = std::max(below[b], below[b + span / 2U]);
+			blocks.push_back(std::move(level));
+		}
+	}
+
+	size_t size() const { return values.size(); }
+
+	// The largest of [first, last)
+	uint16_t operator()(const size_t first, const size_t last) const
+	{
+		const size_t first_block = first / BLOCK, last_block = (last - 1U) / BLOCK;
+		if(first_block == last_block)
+			return *std::max_element(values.begin() + first, values.begin() + last);
+		const uint16_t ends = std::max(suffix[first], prefix[last - 1U]);
+		return first_block + 1U < last_block ? std::max(ends, blockMax(first_block + 1U, last_block))
+											 : ends;
+	}
+};
+
+struct GridLayout
+{
+	size_t rows;
+	std::vector<uint16_t> widths;	 // Of every column
+};
+
+// The densest grid for entries `width` columns wide each (and `extra` more for what follows
+// them), `gap` apart behind an `indent`, in `line` columns. One column if nothing else fits
+inline GridLayout planGrid(const RangeMax& width, const size_t extra, const size_t indent,
+						   const size_t gap, const size_t line)
+{
+	const size_t count = width.size();
+	if(count == 0U)
+		return {0U, {}};
+	GridLayout grid {count, {}};
+	// Every entry takes at least a column and the gap
+	for(size_t cols = std::min(count, line / (1U + extra + gap) + 1U); cols > 1U; --cols)
+	{
+		const size_t rows = (count + cols - 1U) / cols;
+		// Fewer columns would come out of the same number of rows, that count is tried on its own
+		if((count + rows - 1U) / rows != cols)
+			continue;
+		size_t used = indent;
+		grid.widths.clear();
+		for(size_t first = 0U; first < count && used <= line; first += rows)
+		{
+			grid.widths.push_back(width(first, std::min(first + rows, count)));
+			used += (first ? gap : 0U) + grid.widths.back() + extra;
+		}
+		if(used <= line)
+		{
+			grid.rows = rows;
+			return grid;
+		}
+	}
+	grid.widths.assign(1U, width(0U, count));
+	return grid;
+}
+
+#endif
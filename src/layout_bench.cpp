@@ -0,0 +1,101 @@
+// The grid planner on its own, `make bench-layout` then `../bin/layout_bench [COUNT|DIRECTORY]`.
+// Entry widths come from a directory's names, or are made up (mostly 8 to 24 columns, now and
+// then up to 80) for COUNT entries, 100000 by default. Every terminal width is planned by
+// planGrid() and by trying every column count the slow way, which has to come out the same
+
+#include "icons.hpp"
+#include "layout.hpp"
+#include "scan.hpp"
+#include "width.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// Every count from the most down, each column's width found by looking at all of its entries
+GridLayout planSlowly(const std::vector<uint16_t>& widths, const size_t extra, const size_t line)
+{
+	const size_t count = widths.size();
+	for(size_t cols = std::min(count, line / (1U + extra + 4U) + 1U); cols > 1U; --cols)
+	{
+		const size_t rows = (count + cols - 1U) / cols;
+		if((count + rows - 1U) / rows != cols)
+			continue;
+		GridLayout grid {rows, {}};
+		size_t used = 4U;
+		for(size_t first = 0U; first < count; first += rows)
+		{
+			grid.widths.push_back(*std::max_element(widths.begin() + first,
+													widths.begin() + std::min(first + rows, count)));
+			used += (first ? 4U : 0U) + grid.widths.back() + extra;
+		}
+		if(used <= line)
+			return grid;
+	}
+	return {count, {*std::max_element(widths.begin(), widths.end())}};
+}
+
+template<typename Function>
+double medianMicroseconds(Function&& function)
+{
+	std::vector<double> times;
+	for(int run = 0; run < 21; ++run)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		function();
+		times.push_back(
+			std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::nth_element(times.begin(), times.begin() + 10, times.end());
+	return times[10];
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<uint16_t> widths;
+	const std::string what = argc > 1 ? argv[1] : "100000";
+	if(what.find_first_not_of("0123456789") == std::string::npos)
+	{
+		std::mt19937 random(1U);
+		widths.resize(std::strtoul(what.c_str(), nullptr, 10));
+		for(uint16_t& width: widths)
+			width = 2U + (random() % 16U ? 8U + random() % 17U : 1U + random() % 80U);
+	}
+	else
+	{
+		DirScanner scanner(what);
+		if(!scanner.good())
+		{
+			std::fprintf(stderr, "Can't open %s\n", what.c_str());
+			return 2;
+		}
+		while(scanner.batch([&](const RawEntry* entry) {
+			widths.push_back(iconWidth(findIcon(entry->d_name)) + displayWidth(entry->d_name));
+		}))
+			;
+	}
+	if(widths.empty())
+		return 0;
+
+	std::printf("%zu entries\n%8s %6s %6s %12s %12s\n", widths.size(), "columns", "rows", "cols",
+				"planGrid us", "every us");
+	for(const size_t line: {80U, 120U, 200U, 400U})
+	{
+		GridLayout fast, slow;
+		const double fast_time =
+			medianMicroseconds([&] { fast = planGrid(RangeMax(widths), 1U, 4U, 4U, line); });
+		const double slow_time = medianMicroseconds([&] { slow = planSlowly(widths, 1U, line); });
+		if(fast.rows != slow.rows || fast.widths != slow.widths)
+		{
+			std::fprintf(stderr, "Different grids for %zu columns\n", line);
+			return 1;
+		}
+		std::printf("%8zu %6zu %6zu %12.0f %12.0f\n", line, fast.rows, fast.widths.size(),
+					fast_time, slow_time);
+	}
+	return 0;
+}
@@ -0,0 +1,50 @@
+#include "liblist.hpp"
+
+#include "meta.hpp"
+#include "scan.hpp"
+
+#include <cerrno>
+
+namespace liblist
+{
+int scan(const std::string& path, const Options& opts, EntryTable& table)
+{
+	DirScanner scanner(path);
+	if(!scanner.good())
+		return errno;
+	while(scanner.batch([&](const RawEntry* entry) {
+		if(opts.show_all || entry->d_name[0] != '.')
+			table.add(entry->d_name, entry->d_type);
+	}))
+		;
+	if(scanner.error())
+		return scanner.error();
+	table.fetchMeta(opts.io_mode,
+					opts.jobs,
+					scanner.dirfd(),
+					metaMask(opts.long_list) | sortMask(opts.sort_mode));
+	return 0;
+}
+
+std::vector<uint32_t> sort(const EntryTable& table, const SortMode mode, const bool reverse)
+{
+	return sortTable(table, mode, reverse);
+}
+
+void render(const EntryTable& table, const std::vector<uint32_t>& order, const Sink& sink,
+			const Options& opts, const Style& style)
+{
+	if(order.empty())
+		return;
+	IdCache nss_ids;
+	IdCache& ids = style.ids ? *style.ids : nss_ids;
+	Summary summary;
+	summary.addNames(table);
+	summary.addMeta(table, ids, opts.long_list);
+
+	OutBuf out(sink);
+	Printer printer(out, *style.theme, ids, opts, summary, style.width);
+	printer.print(table, order);
+	printer.finish();
+}
+}	 // namespace liblist
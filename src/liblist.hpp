@@ -0,0 +1,51 @@
+#ifndef LIBLIST_HPP
+#define LIBLIST_HPP
+
+// liblist, the listing without the process around it, for tools that would otherwise run list
+// and parse its colored output. `make lib` builds ../bin/liblist.a and ../bin/liblist.so, link
+// either with -pthread. A listing is three calls, each doing what the matching step of list
+// does:
+//
+//	std::pmr::monotonic_buffer_resource memory;
+//	EntryTable table(&memory);
+//	liblist::scan("/some/dir", opts, table);
+//	liblist::render(table, liblist::sort(table, opts.sort_mode), sink, opts);
+//
+// The table takes all of its memory from the resource it's made with, and render() hands the
+// sink its output buffer in place, so nothing is copied on the way out
+
+#include "idcache.hpp"
+#include "output.hpp"
+#include "render.hpp"
+#include "sortkey.hpp"
+#include "table.hpp"
+#include "theme.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace liblist
+{
+// What render() needs besides the options, plain text in 80 columns by default
+struct Style
+{
+	const Theme* theme = &themes[static_cast<uint8_t>(ColorDepth::none)];
+	unsigned short width = 80U;
+	IdCache* ids = nullptr;	   // Owner names for the long listing, a new NSS cache when null
+};
+
+// Appends the entries of the directory at `path` to `table`, dotfiles only with show_all, with
+// the metadata the sort and (long_list) the long listing need. 0, or why it couldn't be read
+int scan(const std::string& path, const Options& opts, EntryTable& table);
+
+// The order the table is listed in, indices into it, directories first like list does
+std::vector<uint32_t> sort(const EntryTable& table, SortMode mode, bool reverse = false);
+
+// Lays the table out the way list would for `opts`, in `order`, and writes it to `sink`.
+// Nothing at all for an empty order
+void render(const EntryTable& table, const std::vector<uint32_t>& order, const Sink& sink,
+			const Options& opts, const Style& style = Style());
+}	 // namespace liblist
+
+#endif
@@ -2,226 +2,287 @@
 // different color, greenish for dirs orangish for files. and add an '@' maybe?
 // TODO Follow symlink and show where it goes in ls -l
 
-// FIXME: isatty() check and assume the default width is 80(?)
-
-// FIXME: Unicode characters count as 2 or 4 long but they display as one, fix that
-
 // Includes
 #include "args.hpp"
-#include "icons.cpp"
+#include "cache.hpp"
+#include "du.hpp"
+#include "extsort.hpp"
+#include "git.hpp"
+#include "icons.hpp"
+#include "idcache.hpp"
+#include "meta.hpp"
+#include "output.hpp"
+#include "render.hpp"
+#include "scan.hpp"
+#include "server.hpp"
+#include "sortkey.hpp"
+#include "table.hpp"
+#include "theme.hpp"
+#include "top.hpp"
+#include "tree.hpp"
+#include "uring.hpp"
+#include "watch.hpp"
 
 #include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <cstring>
 #include <ctime>
 #include <filesystem>
-#include <grp.h>
-#include <iomanip>
 #include <iostream>
-#include <pwd.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 
-// Defines
-#define DAY	 86400U	   // Day in seconds
-#define HOUR 3600U	   // Hour in seconds
-
-class Color
+// The directory couldn't be opened or read to the end, `error` says why
+int readFailed(const Theme& theme, const char* what, const int error)
 {
-private:
-	const uint8_t r, g, b;
+	OutBuf out(STDERR_FILENO);
+	out.append("    ", 4U)
+		.append(theme[ERROR])
+		.append(what)
+		.append(std::strerror(error))
+		.append(theme[RESET])
+		.put('\n');
+	return 2;
+}
 
-	friend std::ostream& operator<<(std::ostream& os, const Color& color)
+// Unsorted one-per-line and -l listings don't need to see the whole directory before printing,
+// so every getdents buffer is rendered as soon as it's read and memory stays the same however
+// big the directory is. -l can't know the widest owner or size up front, those columns get
+// fixed widths instead
+int streamDirectory(const std::string& directory, const Options& opts, IdCache& ids,
+					const Theme& theme)
+{
+	// Wide enough for 8 character names and sizes up to 9999999999 bytes
+	const size_t user_width = 8U, group_width = 8U, size_width = opts.human_readable ? 4U : 10U;
+	const unsigned int mask = metaMask(opts.long_list);
+	TimeFormat times(opts.time_style, std::time(NULL));
+
+	DirScanner scanner(directory);
+	if(!scanner.good())
+		return readFailed(theme, "Couldn't open: ", scanner.error());
+	EntryTable batch;
+	OutBuf out;
+	bool empty = true;
+	// --top=N stops reading after the first N
+	size_t left = opts.top ? opts.top : SIZE_MAX;
+	while(left && scanner.batch([&](const RawEntry* entry) {
+		if((opts.show_all || entry->d_name[0] != '.') && batch.size() < left)
+			batch.add(entry->d_name, entry->d_type);
+	}))
 	{
-		char buffer[24];
-		sprintf(buffer, "\033[38;2;%u;%u;%um", color.r, color.g, color.b);
-		os << buffer;
-		return os;
+		batch.fetchMeta(opts.io_mode, opts.jobs, scanner.dirfd(), mask);
+		left -= batch.size();
+		for(uint32_t i = 0U; i < batch.size(); ++i)
+			if(opts.long_list)
+				printLong(out,
+						  theme,
+						  File(batch, i),
+						  ids,
+						  "  ",
+						  user_width,
+						  group_width,
+						  size_width,
+						  opts.human_readable,
+						  times);
+			else
+			{
+				File(batch, i).render(out.append("    ", 4U), theme);
+				out.put('\n');
+			}
+		empty = empty && batch.empty();
+		batch.clear();
 	}
-
-public:
-	const std::string str() const
+	if(scanner.error())
 	{
-		char buffer[24];
-		sprintf(buffer, "\033[38;2;%u;%u;%um", this->r, this->g, this->b);
-		return std::string(buffer);
+		out.flush();
+		return readFailed(theme, "Couldn't read: ", scanner.error());
 	}
 
-	Color() : r(0), g(0), b(0) {}
-	explicit Color(uint8_t gs) : r(gs), g(gs), b(gs) {}
-	explicit Color(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
-};
-
-// COMMON COLORS
-const static std::string RESET = "\033[m", BLACK = "\033[38;2;0;0;0m",
-						 WHITE = "\033[38;2;255;255;255m", RED = "\033[38;2;255;0;0m",
-						 GREEN = "\033[38;2;0;255;0m", BLUE = "\033[38;2;0;0;255m",
-						 YELLOW = "\033[38;3;255;255;0m", MAGENTA = "\033[38;2;255;0;255m",
-						 CYAN = "\033[38;2;3;255;255m", PURPLE = "\033[38;2;127;32;183m",
-						 LIME = "\033[38;2;111;255;8m", BROWN = "\033[38;2;142;69;23m",
-						 ORANGE = "\033[38;2;255;127;8m";
-
-// Human Readable File Sizes
-std::string humane(const uint64_t& size)
-{
-	char buff[16U];
-	bool giga = size / 1000000000U, mega = size / 1000000U, kilo = size / 1000U;
-	if(kilo)
-		sprintf(buff,
-				"%lu%c",
-				giga ? size / 1000000000U : (mega ? size / 1000000U : (kilo ? size / 1000U : size)),
-				giga ? 'G' : mega ? 'M' : kilo ? 'K' : 'B');
-	else
-		sprintf(buff, "%luB", size);
-
-	return std::string(buff);
+	if(empty)
+		out.append("    ", 4U)
+			.append(theme[NOTICE])
+			.append("Nothing to show here...\n")
+			.append(theme[RESET]);
+	return 0;
 }
 
-const std::string to_lower(const std::string& str)
+// The temporary file --mem-limit spills to couldn't be created, written or read back
+int spillFailed(const Theme& theme)
 {
-	std::string temp = "";
-	for(const unsigned char& letter: str)
-		temp += (unsigned char)std::tolower(letter);
-
-	return temp;
+	OutBuf out(STDERR_FILENO);
+	out.append("    ", 4U)
+		.append(theme[ERROR])
+		.append("Couldn't use a temporary file for --mem-limit. ")
+		.append(theme[RESET])
+		.put('\n');
+	return 2;
 }
 
-bool is_digit(const std::string& str)
+int usage()
 {
-	return (std::find_if(str.begin(), str.end(), [](const char& c) { return !std::isdigit(c); }) ==
-			str.end());
+	std::cout << "\tUsage: `list [OPTIONS] [FILE]` the order doesn't matter\n"
+				 "\n\t-a, --all\t\t\tShow files which start with . (dotfiles), ignores '.' and "
+				 "'..'\n"
+				 "\t-h, --human\t\t\tPrint file sizes in a human readable format (1024B = 1KB)\n"
+				 "\t-l, --long\t\t\tUse a long listing format, size, owners, modification time\n"
+				 "\t-t, -S, -X\t\t\tSort by modification time (newest first), size (largest "
+				 "first) or extension, directories still come first\n"
+				 "\t-r, --reverse\t\tReverse the order\n"
+				 "\t-U\t\t\t\tDon't sort, list in directory order. With -1 or -l (or when "
+				 "piped) entries are printed as they're read\n"
+				 "\t-f\t\t\t\tSame as -aU\n"
+				 "\t--sort=WORD\t\t\tname, time, size, extension or none. Piped output isn't "
+				 "sorted unless a sort is given\n"
+				 "\t--color=WHEN\t\tauto (default, none when piped or NO_COLOR is set), always, "
+				 "never, 256, 16\n"
+				 "\t--io=sync|uring\t\tHow -l collects file metadata, io_uring batches the stat "
+				 "calls\n"
+				 "\t--ids=nss|files\t\tResolve owner names through NSS or straight from "
+				 "/etc/passwd, /etc/group\n"
+				 "\t--jobs=N\t\t\tCollect file metadata on N threads, for slow (network) "
+				 "filesystems\n"
+				 "\t--mem-limit=SIZE\t\tKeep a sorted listing within about SIZE bytes (64M, 1G, "
+				 "...) by spilling sorted runs to $TMPDIR and merging them\n"
+				 "\t-R, --recursive\t\tList every directory underneath too, on --jobs threads "
+				 "(all cores by default)\n"
+				 "\t--tree[=DEPTH]\t\tShow the directories underneath as a tree, DEPTH levels "
+				 "deep\n"
+				 "\t--du[=disk]\t\t\tLong listing with the total size of every directory, "
+				 "apparent or allocated on disk\n"
+				 "\t-x\t\t\t\tDon't walk into other filesystems with -R, --tree and --du\n"
+				 "\t--max-fds=N\t\t\tKeep at most N directories open while walking (256)\n"
+				 "\t--cache\t\t\t\tKeep what was read in $XDG_CACHE_HOME/list and reuse it "
+				 "until the directory changes (entry sizes and times can be stale)\n"
+				 "\t--serve\t\t\t\tStay running and do the listings of every other list run "
+				 "with $LIST_SERVER set, which hand them over whenever it's up\n"
+				 "\t--local\t\t\t\tList in this process even when a server is running\n"
+				 "\t--git\t\t\t\tShow what git status would say about every entry, M modified, "
+				 "? untracked, ! ignored, U unmerged\n"
+				 "\t--top=N\t\t\tOnly the first N entries of the sorted listing, e.g. the 50 "
+				 "largest with -S --top=50, without holding on to the rest\n"
+				 "\t--time-style=STYLE\t-l's times as iso, long-iso, full-iso (to the nanosecond) "
+				 "or relative (5 minutes ago)\n"
+				 "\t--watch\t\t\t\tKeep the listing on screen and up to date as the directory "
+				 "changes, until Ctrl-C\n"
+				 "\t--help, --usage,\n\t--version, -v, -H\tPrint this help screen\n";
+	return 1;
 }
 
-class File
+// The terminal's width, 80 columns when there's no terminal to ask
+inline unsigned short getWidth()
 {
-public:
-	std::string name, short_name, icon;
-	bool isDir;
-	uint64_t _size;
-
-	File(const std::string& file, unsigned long index, bool dir, uint64_t size) :
-		name(file), short_name(file.substr(index)), icon("\uf15b "), isDir(dir), _size(size)
-	{
-		this->findIcon();
-	}
-	File(const std::string& file) : name(file) {}
-
-	friend std::ostream& operator<<(std::ostream& os, const File& file)
-	{
-		if(file.isDir)
-			os << Color(20, 162, 254) << (file.icon == "\uf15b " ? "\ue5fe " : file.icon)
-			   << file.short_name << '/' << RESET;
-		else
-			os << GREEN << file.icon << file.short_name << RESET << ' ';
-		return os;
-	}
-
-	std::string str() const
-	{
-		std::string temp = "";
-		if(this->isDir)
-			temp += Color(20, 162, 254).str() + (this->icon == "\uf15b " ? "\ue5fe " : this->icon) +
-					this->short_name + '/' + RESET;
-		else
-			temp += GREEN + this->icon + this->short_name + RESET + ' ';
-
-		return temp;
-	}
+	struct winsize size {};
+	return ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col ? size.ws_col : 80U;
+}
 
-	std::string inline getExtension() const
+// -R, every directory under its path, listed the way a single one would be
+void printRecursive(OutBuf& out, const Theme& theme, IdCache& ids, const Options& opts,
+					TreeWalker& walker, TreeNode& node, const unsigned short term_width)
+{
+	if(walker.wait(node) == TreeNode::skipped)
+		return;
+	if(node.parent)
+		out.put('\n');
+	out.append(theme[DIRECTORY]).append(node.path).put(':').append(theme[RESET]).put('\n');
+	if(node.status == TreeNode::failed)
 	{
-		if(this->short_name.find('.') != std::string::npos)
-			return this->short_name.substr(this->short_name.rfind('.') + 1);
-		else
-			return this->short_name;
+		out.append("    ", 4U)
+			.append(theme[ERROR])
+			.append("Couldn't open: ")
+			.append(std::strerror(node.error))
+			.append(theme[RESET])
+			.put('\n');
+		return;
 	}
 
-	std::string inline getFilename() const
-	{
-		if(this->short_name.find('.') != std::string::npos)
-			return this->short_name.substr(0, this->short_name.rfind('.'));
-		else
-			return this->short_name;
-	}
+	Summary summary;
+	summary.addNames(node.table);
+	summary.addMeta(node.table, ids, opts.long_list);
+	Printer printer(out, theme, ids, opts, summary, term_width);
+	printer.print(node.table, node.order);
+	printer.finish();
 
-	void findIcon()
+	// Each subtree is dropped as soon as it's printed
+	for(std::unique_ptr<TreeNode>& child: node.children)
 	{
-		const std::string& extension = this->getExtension();
-		if(icons.find(extension) != icons.end())
-			this->icon = icons.at(extension);
+		printRecursive(out, theme, ids, opts, walker, *child, term_width);
+		child.reset();
 	}
+}
 
-	size_t length() const { return short_name.size(); }
+// --tree, one entry per line under the directory it's in
+void printTree(OutBuf& out, const Theme& theme, TreeWalker& walker, TreeNode& node,
+			   std::string& prefix)
+{
+	if(walker.wait(node) != TreeNode::listed)
+		return;
 
-	std::string inline size(const bool& human_readable = false) const
+	size_t next = 0U;
+	for(size_t k = 0U; k < node.order.size(); ++k)
 	{
-		if(this->isDir)
-			return (human_readable ? humane(4096) : std::to_string(4096));
-		else
-			return (human_readable ? humane(this->_size) : std::to_string(this->_size));
-	}
+		const uint32_t i = node.order[k];
+		const bool last = k + 1U == node.order.size();
+		out.append("    ", 4U).append(prefix).append(last ? "└── " : "├── ");
+		File(node.table, i).render(out, theme);
+		out.put('\n');
 
-	bool operator<(const File& file) const
-	{
-		if(!this->isDir && file.isDir)
-			return false;
-		else if(this->isDir && !file.isDir)
-			return true;
-		else if(is_digit(this->getFilename()) && is_digit(file.getFilename()))
-			// Breaks Mac compatibility (UNIX)
-			return strverscmp(this->short_name.c_str(), file.short_name.c_str()) < 0;
-
-		return (to_lower(this->short_name) < to_lower(file.short_name));
+		if(next < node.children.size() && node.children[next]->entry == i)
+		{
+			const size_t length = prefix.size();
+			prefix.append(last ? "    " : "│   ");
+			printTree(out, theme, walker, *node.children[next], prefix);
+			prefix.resize(length);
+			node.children[next++].reset();
+		}
 	}
+}
 
-	std::pair<std::string, bool> getPerms() const
+int listRecursive(const std::string& directory, const Options& opts, IdCache& ids,
+				  const Theme& theme)
+{
+	WalkOptions walk;
+	walk.show_all = opts.show_all;
+	walk.reverse = opts.reverse;
+	walk.one_filesystem = opts.one_filesystem;
+	walk.sort_mode = opts.sort_mode;
+	walk.mask = sortMask(opts.sort_mode) | (opts.tree ? 0U : metaMask(opts.long_list));
+	walk.depth = opts.depth;
+	walk.max_handles = opts.max_handles;
+	walk.jobs = opts.jobs;
+	TreeWalker walker(directory, walk);
+
+	OutBuf out;
+	if(opts.tree)
 	{
-		namespace fs = std::filesystem;
-		std::stringstream permissions;
-		fs::perms p(std::filesystem::status(this->name).permissions());
-		permissions
-			<< ((p & fs::perms::owner_read) != fs::perms::none ? (Color(230, 220, 59).str() + "r")
-															   : (Color(88, 40, 128).str() + "-"))
-			<< ((p & fs::perms::owner_write) != fs::perms::none ? (Color(42, 228, 52).str() + "w")
-																: (Color(88, 40, 128).str() + "-"))
-			<< ((p & fs::perms::owner_exec) != fs::perms::none ? (Color(224, 58, 32).str() + "x")
-															   : (Color(88, 40, 128).str() + "-"))
-			<< ((p & fs::perms::group_read) != fs::perms::none ? (Color(230, 220, 59).str() + "r")
-															   : (Color(88, 40, 128).str() + "-"))
-			<< ((p & fs::perms::group_write) != fs::perms::none ? (Color(42, 228, 52).str() + "w")
-																: (Color(88, 40, 128).str() + "-"))
-			<< ((p & fs::perms::group_exec) != fs::perms::none ? (Color(224, 58, 32).str() + "x")
-															   : (Color(88, 40, 128).str() + "-"))
-			<< ((p & fs::perms::others_read) != fs::perms::none ? (Color(230, 220, 59).str() + "r")
-																: (Color(88, 40, 128).str() + "-"))
-			<< ((p & fs::perms::others_write) != fs::perms::none ? (Color(42, 228, 52).str() + "w")
-																 : (Color(88, 40, 128).str() + "-"))
-			<< ((p & fs::perms::others_exec) != fs::perms::none ? (Color(224, 58, 32).str() + "x")
-																: (Color(88, 40, 128).str() + "-"))
-			<< RESET << ' ';
-		return std::make_pair(permissions.str(), (p & fs::perms::owner_exec) != fs::perms::none);
+		out.append("    ", 4U)
+			.append(theme[DIRECTORY])
+			.append(directory)
+			.append(theme[RESET])
+			.put('\n');
+		std::string prefix;
+		printTree(out, theme, walker, walker.root(), prefix);
 	}
-};
-
-void usage()
-{
-	std::cout << "\tUsage: `list [OPTIONS] [FILE]` the order doesn't matter\n"
-				 "\n\t-a, --all\t\t\tShow files which start with . (dotfiles), ignores '.' and "
-				 "'..'\n"
-				 "\t-h, --human\t\t\tPrint file sizes in a human readable format (1024B = 1KB)\n"
-				 "\t-l, --long\t\t\tUse a long listing format, size, owners, modification time\n"
-				 "\t--help, --usage,\n\t--version, -v, -H\tPrint this help screen\n";
-	exit(1);
-}
+	else
+		printRecursive(out, theme, ids, opts, walker, walker.root(), getWidth());
 
-inline unsigned short getWidth()
-{
-	struct winsize size;
-	ioctl(STDOUT_FILENO, TIOCGWINSZ, &size);
-	return size.ws_col;
+	if(walker.root().status != TreeNode::failed)
+		return 0;
+	// -R has said so under the directory's name already
+	if(opts.tree)
+		out.append("    ", 4U)
+			.append(theme[ERROR])
+			.append("Couldn't open: ")
+			.append(std::strerror(walker.root().error))
+			.append(theme[RESET])
+			.put('\n');
+	return 2;
 }
 
-int main(int argc, char** argv)
+// One whole run, with owner names from `nss_ids` or (--ids=files) `file_ids`
+int list(int argc, char** argv, IdCache& nss_ids, IdCache& file_ids)
 {
 	// Parse the arguments
 	Args arg_parser(argc, argv);
@@ -229,14 +290,53 @@ int main(int argc, char** argv)
 
 	if(arg_parser.optExists("--help", "--usage") || arg_parser.optExists("-H", "-v") ||
 	   arg_parser.optExists("--version"))
-		usage();
-
-	std::vector<File> dir;
-	dir.reserve(16U);
-	const bool show_all = arg_parser.optExists("-a", "--all"),
-			   long_list = arg_parser.optExists("-l", "--long"),
-			   human_readable = arg_parser.optExists("-h", "--human"),
-			   one_line = arg_parser.optExists("-1", "--one-line");
+		return usage();
+
+	Options opts;
+	opts.show_all = arg_parser.optExists("-a", "--all") || arg_parser.optExists("-f");
+	opts.long_list = arg_parser.optExists("-l", "--long");
+	opts.human_readable = arg_parser.optExists("-h", "--human");
+	opts.one_line = arg_parser.optExists("-1", "--one-line");
+	opts.reverse = arg_parser.optExists("-r", "--reverse");
+	const std::string sort_word = arg_parser.getValue("--sort");
+	opts.sort_mode = arg_parser.optExists("-U", "-f") || sort_word == "none" ? SortMode::none
+					 : arg_parser.optExists("-t") || sort_word == "time"	 ? SortMode::mtime
+					 : arg_parser.optExists("-S") || sort_word == "size"	 ? SortMode::size
+					 : arg_parser.optExists("-X") || sort_word == "extension"
+						 ? SortMode::extension
+						 : SortMode::name;
+	opts.io_mode = arg_parser.getValue("--io") == "uring" ? IoMode::uring : IoMode::sync;
+	opts.jobs = std::clamp(std::atoi(arg_parser.getValue("--jobs", "1").c_str()), 1, 256);
+	opts.mem_limit = parseSize(arg_parser.getValue("--mem-limit"));
+	opts.recursive = arg_parser.optExists("-R", "--recursive");
+	opts.tree = arg_parser.optExists("--tree") || !arg_parser.getValue("--tree").empty();
+	if(const int depth = std::atoi(arg_parser.getValue("--tree").c_str()); depth > 0)
+		opts.depth = depth;
+	opts.one_filesystem = arg_parser.optExists("-x", "--one-file-system");
+	// The totals only show up in the long listing, and can't be spilled with --mem-limit
+	opts.du = arg_parser.optExists("--du") || !arg_parser.getValue("--du").empty();
+	opts.du_disk = arg_parser.getValue("--du") == "disk";
+	opts.long_list = opts.long_list || opts.du;
+	opts.cache = arg_parser.optExists("--cache");
+	opts.watch = arg_parser.optExists("--watch");
+	opts.git = arg_parser.optExists("--git");
+	opts.time_style = parseTimeStyle(arg_parser.getValue("--time-style"));
+	opts.top = std::strtoull(arg_parser.getValue("--top").c_str(), nullptr, 10);
+	// --top never holds more than N entries, there's nothing to spill
+	opts.mem_limit = opts.du || opts.cache || opts.git || opts.top ? 0U : opts.mem_limit;
+	opts.max_handles = std::max(std::atoi(arg_parser.getValue("--max-fds", "256").c_str()), 0);
+	// The walk (and --git's hashing) is spread over every core unless --jobs says otherwise
+	if((opts.recursive || opts.tree || opts.du || opts.git) &&
+	   arg_parser.getValue("--jobs").empty())
+		opts.jobs = std::max(std::thread::hardware_concurrency(), 1U);
+	// Piped output without any sort asked for doesn't get sorted either, except for the walks,
+	// which hold on to every directory until it's printed anyway
+	const bool tty = isatty(STDOUT_FILENO);
+	if(!tty && sort_word.empty() && !opts.reverse && !opts.recursive && !opts.tree &&
+	   !(arg_parser.optExists("-t", "-S") || arg_parser.optExists("-X")))
+		opts.sort_mode = SortMode::none;
+	IdCache& ids = arg_parser.getValue("--ids") == "files" ? file_ids : nss_ids;
+	const Theme& theme = selectTheme(arg_parser.getValue("--color", "auto"));
 
 	std::string directory(".");
 	for(const auto& item: arg_parser.getOpts())
@@ -250,291 +350,263 @@ int main(int argc, char** argv)
 	// message and `return 3`
 	if(!std::filesystem::exists(std::filesystem::path(directory)))
 	{
-		std::cout << "    \033[1;31m"
-				  << "Directory Not Found. " << RESET << '\n';
+		OutBuf out;
+		out.append("    ", 4U)
+			.append(theme[ERROR])
+			.append("Directory Not Found. ")
+			.append(theme[RESET])
+			.put('\n');
 		return 3;
 	}
 	// TODO Check if -l has been passed, and move those printings to functions. One for
 	// regular printing, one for long listing
 	else if(std::filesystem::is_regular_file(std::filesystem::path(directory)))
 	{
-		std::filesystem::directory_entry entry(directory);
-		File temp(directory,
-				  directory.rfind('/') + 1U,
-				  entry.is_directory(),
-				  entry.is_regular_file() ? entry.file_size() : 0UL);
-		if(long_list)
+		FileMeta meta;
+		fetchMeta(AT_FDCWD, directory.c_str(), metaMask(opts.long_list), meta);
+		EntryTable single;
+		single.add(std::string_view(directory).substr(directory.rfind('/') + 1U),
+				   IFTODT(meta.mode));
+		single.setMeta(0U, meta);
+		const File temp(single, 0U);
+		OutBuf out;
+		if(opts.long_list)
 		{
-			const std::string& size = temp.size(human_readable);
-
-			struct stat info;
-			stat(temp.name.c_str(), &info);
-			struct passwd* pw = getpwuid(info.st_uid);
-			struct group* gr = getgrgid(info.st_gid);
-			std::string uname(pw->pw_name);				 // Owner-User
-			std::string group(gr->gr_name);				 // Owner-Group
-			std::time_t modify = info.st_mtim.tv_sec;	 // Last Modified
-														 // Time
-			std::time_t now = std::time(NULL);
-			std::string m_time(ctime(&modify));	   // Convert time_t
-												   // into a prettier
-												   // string equivelant
-			m_time.erase(m_time.end() - 1);		   // Get rid of the last '\n'
-
-			// FIXME fix the blue colors, too
-			// similar
-
-			// Set the color of the Modification
-			// Time, 3 Days -> 1 Day -> 6 Hours ->
-			// 1 Hour
-			std::time_t diff = now - modify;
-			std::string time_color;
-			if(diff > 3 * DAY)
-				time_color = Color(32, 123, 121).str();
-			else if(diff > DAY && diff < 3 * DAY)
-				time_color = Color(72, 144, 240).str();
-			else if(diff < DAY && diff > 6 * HOUR)
-				time_color = Color(108, 222, 171).str();
-			else if(diff < 6 * HOUR && diff > HOUR)
-				time_color = Color(146, 240, 190).str();
-			else
-				time_color = Color(20, 255, 40).str();
-
-			// Size Colors
-			std::string size_color;
-			if(temp._size < 1000000ULL)	   // temp < 1 MB
-				size_color = WHITE;
-			else if(temp._size < 128000000ULL)	  // temp < 128MB
-				size_color = Color(113, 220, 208).str();
-			else if(temp._size < 512000000ULL)	  // temp < 512MB
-				size_color = Color(253, 254, 42).str();
-			else if(temp._size < 1000000000ULL)	   // temp < 1GB
-				size_color = Color(222, 132, 88).str();
-			else
-				size_color = CYAN;
-
-			std::cout << "    " << temp.getPerms().first << std::right
-					  << std::setw(std::string(getpwuid(geteuid())->pw_name).length() -
-								   uname.length() + 1)
-					  << ' ' << (pw == 0 ? (RED + "ERROR " + RESET) : (uname + RESET + ' '))
-					  << std::setw(std::string(getgrgid(geteuid())->gr_name).length() -
-								   group.length() + 1)
-					  << ' '
-					  << (gr == 0 ? (RED + "ERROR " + RESET)
-								  : (Color(205, 196, 101).str() + group + RESET))
-					  << std::right
-					  << std::setw((human_readable ? 4 : std::to_string(temp._size).length()) -
-								   size.length() + 1)
-					  << ' ' << size_color << size << RESET << "  " << time_color << m_time << RESET
-					  << "  " << temp.str() << '\n';
+			TimeFormat times(opts.time_style, std::time(NULL));
+			char size[24U];
+			printLong(out,
+					  theme,
+					  temp,
+					  ids,
+					  "    ",
+					  ids.user(meta.uid).length(),
+					  ids.group(meta.gid).length(),
+					  opts.human_readable ? 4U : temp.size(size),
+					  opts.human_readable,
+					  times);
 		}
 		else
-			std::cout << "    " << temp.str() << '\n';
+		{
+			temp.render(out.append("    ", 4U), theme);
+			out.put('\n');
+		}
 		return 0;
 	}
 
-	unsigned int max_dir_length = 0U;
-	uint64_t largest_size = 1ULL;
-	// Push Files into dir Vector, if -a isn't
-	// specified don't put dotfiles in
-	for(const auto& entry: std::filesystem::directory_iterator(directory))
+	if(opts.recursive || opts.tree)
+		return listRecursive(directory, opts, ids, theme);
+	if(opts.watch)
+		return Watcher(directory, opts, ids, theme).run();
+
+	// Nothing to sort and nothing to line up, so no need to hold on to the whole directory
+	if(opts.sort_mode == SortMode::none && (opts.one_line || opts.long_list || !tty) &&
+	   !opts.du && !opts.cache && !opts.git)
+		return streamDirectory(directory, opts, ids, theme);
+
+	const unsigned int mask = metaMask(opts.long_list) | sortMask(opts.sort_mode) |
+							  (opts.du_disk ? STATX_BLOCKS : 0U) | (opts.git ? GIT_MASK : 0U);
+	Summary summary;
+	// Metadata pass, only for the entries d_type didn't tell us enough about. With --jobs the
+	// entries are split between threads, nothing below runs until they're all done. The widths
+	// the long listing needs are picked up on the way
+	const auto collect = [&](EntryTable& table, const int dirfd) {
+		table.fetchMeta(opts.io_mode, opts.jobs, dirfd, mask);
+		summary.addMeta(table, ids, opts.long_list);
+	};
+
+	// Push Files into the table, if -a isn't
+	// specified don't put dotfiles in. With --mem-limit the table is sorted and spilled to a
+	// temporary file whenever it (and what sorting it takes) outgrows the limit
+	EntryTable table;
+	std::unique_ptr<RunFile> runs;
+	if(opts.mem_limit && opts.sort_mode != SortMode::none)
 	{
-		File* file;
-		const std::string& path = entry.path();
-
-		if(entry.is_symlink() &&
-		   std::filesystem::is_directory(std::filesystem::read_symlink(entry)))
-			file = new File(path, path.rfind('/') + 1U, entry.is_directory(), 4096UL);
-		else
-			file = new File(path,
-							path.rfind('/') + 1U,
-							entry.is_directory(),
-							entry.is_regular_file() ? entry.file_size() : 0UL);
-
-		// Don't push .dotfiles in the vector if
-		// `-a` isn't specified
-		if(show_all)	// -a
-			dir.push_back(*file);
-		else
+		runs.reset(new RunFile(opts.sort_mode, opts.reverse));
+		if(!runs->good())
+			return spillFailed(theme);
+		// Room for all a run can hold plus one more getdents64 batch, so the columns never
+		// double (and hold the old copy while they do) on the way to the limit. Pages nobody
+		// writes to don't take memory
+		table.reserve(opts.mem_limit / (sizeof(SortKey) + sizeof(uint32_t)) + 16384U,
+					  opts.mem_limit + 256U * 1024U);
+	}
+	DirScanner scanner(directory);
+	if(!scanner.good())
+		return readFailed(theme, "Couldn't open: ", scanner.error());
+	// --cache, a valid cache file replaces the scan and the metadata pass. Without one everything
+	// is read, with all the metadata the cache keeps, and written out for next time
+	if(opts.cache)
+	{
+		if(!loadCache(scanner.dirfd(), table, opts.show_all))
 		{
-			if(file->short_name.front() == '.')
-				continue;
-			else
-				dir.push_back(*file);
+			const std::time_t read_at = std::time(NULL);
+			EntryTable everything;
+			while(scanner.batch(
+				[&](const RawEntry* entry) { everything.add(entry->d_name, entry->d_type); }))
+				;
+			// Half a directory mustn't end up in the cache
+			if(scanner.error())
+				return readFailed(theme, "Couldn't read: ", scanner.error());
+			everything.fetchMeta(opts.io_mode, opts.jobs, scanner.dirfd(), CACHE_MASK);
+			storeCache(scanner.dirfd(), everything, read_at);
+			copyEntries(everything, table, opts.show_all);
 		}
-
-		// Get the longest file/directory in the
-		// directory, to be used when spacing the
-		// columns
-		if(file->length() > max_dir_length)
-			max_dir_length = file->length();
-
-		if(file->_size > largest_size)
-			largest_size = file->_size;
-
-		delete file;
+		// Picked from the whole table, which is here anyway
+		if(opts.top)
+		{
+			TopEntries top(opts.top, opts.sort_mode, opts.reverse);
+			top.offer(table);
+			table.clear();
+			top.fill(table, true);
+		}
+		summary.addNames(table);
+		summary.addMeta(table, ids, opts.long_list);
+	}
+	else if(opts.top)
+	{
+		// Chosen on what the sort needs, the rest of the metadata is only fetched for the
+		// survivors
+		TopEntries top(opts.top, opts.sort_mode, opts.reverse);
+		EntryTable batch;
+		const unsigned int sort_mask = sortMask(opts.sort_mode);
+		while(!top.full() && scanner.batch([&](const RawEntry* entry) {
+			if(opts.show_all || entry->d_name[0] != '.')
+				batch.add(entry->d_name, entry->d_type);
+		}))
+		{
+			batch.fetchMeta(opts.io_mode, opts.jobs, scanner.dirfd(), sort_mask);
+			top.offer(batch);
+			batch.clear();
+		}
+		top.fill(table, sort_mask != 0U);
+		summary.addNames(table);
+		collect(table, scanner.dirfd());
+	}
+	else
+	{
+		while(scanner.batch([&](const RawEntry* entry) {
+			// Don't push .dotfiles in the table if
+			// `-a` isn't specified
+			if(!opts.show_all && entry->d_name[0] == '.')
+				return;
+
+			table.add(entry->d_name, entry->d_type);
+
+			// Get the widest file/directory in the
+			// directory, to be used when spacing the
+			// columns
+			const size_t width = File(table, table.size() - 1U).width();
+			summary.max_width = std::max(summary.max_width, width);
+			summary.name_width += width;
+			++summary.count;
+		}))
+			if(runs && table.footprint(mask != 0U) + table.nameBytes() +
+								  table.size() * (sizeof(SortKey) + sizeof(uint32_t)) >
+							  opts.mem_limit)
+			{
+				collect(table, scanner.dirfd());
+				if(!runs->spill(table))
+					return spillFailed(theme);
+				table.clear();
+			}
+		collect(table, scanner.dirfd());
+	}
+	if(scanner.error())
+		return readFailed(theme, "Couldn't read: ", scanner.error());
+	if(opts.git)
+	{
+		gitStatus(table, directory, scanner.dirfd(), opts.jobs);
+		summary.status_width = table.hasStatus() ? 2U : 0U;
 	}
 
 	// Empty Directory
-	if(dir.size() == 0U)
+	if(summary.count == 0U)
 	{
-		std::cout << "    " << Color(229U, 195U, 38U) << "Nothing to show here...\n" << RESET;
+		OutBuf out;
+		out.append("    ", 4U)
+			.append(theme[NOTICE])
+			.append("Nothing to show here...\n")
+			.append(theme[RESET]);
 		return 0;
 	}
 
-	// Sort Directories Alphabetically
-	// .dotfolders first, 'CAPITAL' and 'lower'
-	// mixed Dirs before Files
-	std::sort(dir.begin(), dir.end());
-	// Find the number of columns and rows to
-	// display in the Terminal
-	const unsigned short term_width = getWidth();
-	const unsigned short cols = term_width / (max_dir_length + 8U);
-
-	// Determine if every file/dir name combined
-	// with spaces can fit in a single row
-	const bool long_filename = cols == 0U;
-	unsigned short rows = long_filename ? 0U : dir.size() / cols;
-	unsigned int total_length = 4U;
-	for(const File& item: dir)
+	/// PRINTING
+	OutBuf out;
+	// --du totals every subdirectory in the background, each line is printed as soon as its
+	// total is in. The size column can't wait for the largest one, it gets a fixed width
+	std::unique_ptr<DuWalker> du;
+	if(opts.du)
 	{
-		// 8U because of the file icon and the
-		// space after it and the occasional
-		// '/' My rows & cols counting sucks so I
-		// do an extra check for one row cases
-		total_length += item.length() + 8U;
-
-		if(total_length >= term_width)
-		{
-			++rows;
-			break;
-		}
+		du.reset(new DuWalker(
+			scanner.dirfd(), directory, opts.jobs, opts.one_filesystem, opts.max_handles));
+		for(uint32_t i = 0U; i < table.size(); ++i)
+			if(table.isDir(i) && !S_ISLNK(table.meta(i).mode))
+				du->add(i, table.name(i));
+		du->start();
+		summary.largest_size = 9999999999ULL;
 	}
-
-	/// PRINTING
-	if(long_list)	 // -l option
+	Printer printer(out, theme, ids, opts, summary, getWidth());
+	if(runs && !runs->empty())
 	{
-		for(const File& item: dir)
-		{
-			const std::string& size = item.size(human_readable);
-
-			struct stat info;
-			stat(item.name.c_str(), &info);
-			struct passwd* pw = getpwuid(info.st_uid);
-			struct group* gr = getgrgid(info.st_gid);
-			std::string uname(pw->pw_name);				 // Owner-User
-			std::string group(gr->gr_name);				 // Owner-Group
-			std::time_t modify = info.st_mtim.tv_sec;	 // Last Modified
-														 // Time
-			std::time_t now = std::time(NULL);
-			std::string m_time(ctime(&modify));	   // Convert time_t
-												   // into a prettier
-												   // string equivelant
-			m_time.erase(m_time.end() - 1);		   // Get rid of the last '\n'
-
-			// FIXME fix the blue colors, too
-			// similar
-
-			// Set the color of the Modification
-			// Time, 3 Days -> 1 Day -> 6 Hours ->
-			// 1 Hour
-			std::time_t diff = now - modify;
-			std::string time_color;
-			if(diff > 3 * DAY)
-				time_color = Color(32, 123, 121).str();
-			else if(diff > DAY && diff < 3 * DAY)
-				time_color = Color(72, 144, 240).str();
-			else if(diff < DAY && diff > 6 * HOUR)
-				time_color = Color(108, 222, 171).str();
-			else if(diff < 6 * HOUR && diff > HOUR)
-				time_color = Color(146, 240, 190).str();
-			else
-				time_color = Color(20, 255, 40).str();
-
-			// Size Colors
-			std::string size_color;
-			if(item._size < 1000000ULL)	   // item < 1 MB
-				size_color = WHITE;
-			else if(item._size < 128000000ULL)	  // item < 128MB
-				size_color = Color(113, 220, 208).str();
-			else if(item._size < 512000000ULL)	  // item < 512MB
-				size_color = Color(253, 254, 42).str();
-			else if(item._size < 1000000000ULL)	   // item < 1GB
-				size_color = Color(222, 132, 88).str();
-			else
-				size_color = CYAN;
-
-			std::cout << "  " << item.getPerms().first << std::right
-					  << std::setw(std::string(getpwuid(geteuid())->pw_name).length() -
-								   uname.length() + 1)
-					  << ' ' << (pw == 0 ? (RED + "ERROR " + RESET) : (uname + RESET + ' '))
-					  << std::setw(std::string(getgrgid(geteuid())->gr_name).length() -
-								   group.length() + 1)
-					  << ' '
-					  << (gr == 0 ? (RED + "ERROR " + RESET)
-								  : (Color(205, 196, 101).str() + group + RESET))
-					  << std::right
-					  << std::setw((human_readable ? 4 : std::to_string(largest_size).length()) -
-								   size.length() + 1)
-					  << ' ' << size_color << size << RESET << "  " << time_color << m_time << RESET
-					  << "  " << item.str() << '\n';
-		}
+		// Merged back while printing, in the same order sorting the whole table would give
+		if(!runs->spill(table))
+			return spillFailed(theme);
+		table = EntryTable();
+		const bool merged = runs->merge([&](const EntryTable& batch) {
+			for(uint32_t i = 0U; i < batch.size(); ++i)
+				printer.print(File(batch, i));
+		});
+		printer.finish();
+		out.flush();
+		return merged ? 0 : spillFailed(theme);
 	}
+
+	// Sort Directories Alphabetically
+	// .dotfolders first, 'CAPITAL' and 'lower'
+	// mixed Dirs before Files
+	// -t, -S and -X order by something else first, -U keeps the directory order as is
+	const std::vector<uint32_t> order = sortTable(table, opts.sort_mode, opts.reverse);
+	if(!du)
+		printer.print(table, order);
 	else
-	{
-		/// REGULAR PRINTING
-		// If max_dir_length > term_width, if the longest string doesn't fit print a file on
-		// new lines
-		// TODO Seperate long -l from this
-		if((long_filename && rows == 1U) || one_line)
-			for(const File& item: dir)
-				std::cout << "    " << item.str() << '\n';
-		// Regular printing for multiple rows
-		else if(rows > 1U)
+		for(const uint32_t i: order)
 		{
-			for(size_t i = 0U; i < dir.size() - (dir.size() % cols); i += (cols))
+			if(!du->ready(i))
+				out.flush();
+			if(const DuWalker::Total* total = du->wait(i))
 			{
-				std::cout << "    ";
-				for(size_t n = 0U; n < cols; n++)
-					if(i + n != dir.size())
-						std::cout << dir[i + n].str() << std::left
-								  << std::setw(max_dir_length - dir[i + n].length() + 4U) << ' ';
-				std::cout << '\n';
+				table.meta(i).size = opts.du_disk ? total->allocated : total->apparent;
+				table.meta(i).mask |= META_TOTAL;
 			}
-			// TODO Integrate libgit2 (git status for files)
-			// TODO ls -t recursive tree structure, default depth=2 probably. Use Unicode
-			// bar (|-_ and shit)
-			// TODO Maybe use multiple vectors, or a double vector for each column so it
-			// looks like colorls, the width of the columns Or just calculate the total
-			// length of each column and keep them in an array/vector
-			// FIXME The if check for last column has probably slowed it down a lot
-			if(dir.size() % cols > 0)
-			{
-				std::cout << "    ";
-				for(size_t i = dir.size() - (dir.size() % cols); i < dir.size(); ++i)
-					if(i % cols == cols - 1U)
-						std::cout << dir[i].str();
-					else
-						std::cout << dir[i].str() << std::left
-								  << std::setw(max_dir_length - dir[i].length() + 4U) << ' ';
-
-				std::cout << '\n';
-			}
-		}
-		// Single Row
-		else
-		{
-			// Single Row Printing
-			std::cout << "    ";
-			for(uint8_t i = 0U; i < dir.size(); ++i)
-				if(i == dir.size() - 1U)
-					std::cout << dir[i].str();
-				else
-					std::cout << dir[i].str() << std::left << std::setw(4U) << ' ';
-			std::cout << '\n';
+			else if(opts.du_disk)
+				table.meta(i).size = table.meta(i).blocks * 512U;
+			printer.print(File(table, i));
 		}
-	}
+	printer.finish();
 
 	return 0;
 }
 
+int main(int argc, char** argv)
+{
+	Args arg_parser(argc, argv);
+	arg_parser.convert();
+
+	// --serve keeps the owner names and the --cache tables of the last few directories warm
+	// for every run it does
+	if(arg_parser.optExists("--serve"))
+	{
+		IdCache nss_ids(false), file_ids(true);
+		WarmTables tables(32U);
+		warm_tables = &tables;
+		return serve(
+			[&](const int count, char** args) { return list(count, args, nss_ids, file_ids); });
+	}
+	// A watch never ends, it can't hold up the server
+	if(!arg_parser.optExists("--local") && !arg_parser.optExists("--watch"))
+		if(const int code = forward(argc, argv); code >= 0)
+			return code;
+
+	IdCache ids(arg_parser.getValue("--ids") == "files");
+	return list(argc, argv, ids, ids);
+}
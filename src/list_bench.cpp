@@ -0,0 +1,835 @@
+// The listing pipeline phase by phase, `make bench` then `../bin/list_bench [options]`. Synthetic
+// trees of 1k, 100k and 1M entries are generated under /dev/shm/list-bench (once, they're kept
+// for the next build to run on) and every run of a tree times what list does to its top
+// directory one step at a time: enumerate (getdents into the table), metadata (-l's statx),
+// sort (by name), layout (the summary and the grid for 200 columns), render (printing that grid)
+// and render_long (printing -l), then walk, -R's reading of the whole tree. Output is thrown
+// away. The median and p99 of every phase go to stdout as JSON, one phase per line so two builds'
+// files can be diffed, and a table goes to stderr. p99 is a nearest rank, with fewer than 100
+// runs it's the slowest one
+//
+//	--sizes=1000,100000,1000000	Entries in the top directories
+//	--runs=N					Runs per tree, 2000000 / entries (5 to 200) by default
+//	--root=DIR					Where the trees go, tmpfs so the disk isn't measured
+//	--fresh						Generate the trees again
+//	--io=sync|uring, --jobs=N	How the metadata is read, as for list. The walk uses every core
+//								unless --jobs is given
+//	--jobs=1,2,4,8,16			Every tree once per thread count, for how the metadata pass and
+//								the walk scale. The -l output has to hash the same for all of
+//								them, list_bench fails if it doesn't
+//
+// --syscalls[=LIST,...] doesn't time anything, it runs list binaries (../bin/list next to
+// list_bench by default) on the trees (100000 entries by default), plain and with -l, and counts
+// their syscalls through ptrace the way strace -f -c would. Against the std::filesystem
+// version list started out as:
+//
+//	git worktree add /tmp/list-baseline 55565d0 && make -C /tmp/list-baseline/src
+//	../bin/list_bench --syscalls=../bin/list,/tmp/list-baseline/bin/list
+//
+// --check-mem-limit[=SIZE] lists the top directory of every tree (10000000 entries by default)
+// with ../bin/list, -1 and -l, sorted by name, once with --mem-limit=SIZE (64M by default) and
+// once without. The two outputs have to be the same byte for byte, and the limited run's peak
+// RSS within SIZE (and 4M of buffers) of what list needs for an empty directory, list_bench
+// fails otherwise. The outputs are written next to the trees and kept when they differ. 10M
+// entries take about 11M inodes and several GB of memory on tmpfs, more than /dev/shm allows:
+//
+//	mount -t tmpfs -o size=8G,nr_inodes=12M tmpfs /mnt/list-bench
+//	../bin/list_bench --check-mem-limit --root=/mnt/list-bench
+//
+// With less memory than that an ext4 image does, on a loop device with direct I/O so its blocks
+// aren't cached twice (-l without the limit reads the inodes over and over otherwise):
+//
+//	truncate -s 40G list-bench.img && mkfs.ext4 -N 12000000 -O large_dir list-bench.img
+//	mount $(losetup -f --show --direct-io=on list-bench.img) /mnt/list-bench
+//	TMPDIR=/mnt/list-bench ../bin/list_bench --check-mem-limit --root=/mnt/list-bench
+
+#include "args.hpp"
+#include "extsort.hpp"
+#include "idcache.hpp"
+#include "meta.hpp"
+#include "output.hpp"
+#include "render.hpp"
+#include "scan.hpp"
+#include "sortkey.hpp"
+#include "table.hpp"
+#include "theme.hpp"
+#include "tree.hpp"
+#include "uring.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <ftw.h>
+#include <linux/magic.h>
+#include <random>
+#include <string>
+#include <map>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Filled in by the Makefile
+#ifndef BENCH_BUILD
+#define BENCH_BUILD ""
+#endif
+#ifndef BENCH_FLAGS
+#define BENCH_FLAGS ""
+#endif
+
+// Bumped whenever the trees come out different, so old ones get replaced
+constexpr int TREE_VERSION = 1;
+
+enum Phase
+{
+	ENUMERATE,
+	METADATA,
+	SORT,
+	LAYOUT,
+	RENDER,
+	RENDER_LONG,
+	WALK,
+	PHASE_COUNT
+};
+constexpr const char* phase_names[PHASE_COUNT] = {
+	"enumerate", "metadata", "sort", "layout", "render", "render_long", "walk"};
+
+/// GENERATING
+
+// A name of mostly 4 to 20 bytes, some up to 60 and a few past 100, a sixth of them with
+// accents, Greek, Cyrillic, CJK (two columns a character), combining marks or emoji in them.
+// `index` keeps it unique
+std::string makeName(std::mt19937& random, const size_t index)
+{
+	static constexpr char letters[] =
+		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-";
+	static constexpr const char* others[] = {"\u00e9",
+											 "\u00fc",
+											 "\u00df",
+											 "\u03bb\u03a9",
+											 "\u0436\u044f",
+											 "\u65e5\u672c",
+											 "\u4e2d\u6587\u5b57",
+											 "\ud55c\uad6d",
+											 "e\u0301",
+											 "\U0001f680",
+											 "\u2713"};
+	static constexpr const char* extensions[] = {
+		"", "", ".txt", ".cpp", ".hpp", ".md", ".json", ".png", ".jpg", ".py", ".tar.gz", ".log"};
+
+	const unsigned int roll = random() % 100U;
+	const size_t length = roll < 70U ? 4U + random() % 17U
+						  : roll < 95U ? 20U + random() % 41U
+									   : 100U + random() % 120U;
+	const bool unicode = random() % 6U == 0U;
+	std::string name;
+	if(random() % 32U == 0U)
+		name.push_back('.');
+	while(name.size() < length)
+		if(unicode && random() % 3U == 0U)
+			name.append(others[random() % std::size(others)]);
+		else
+			name.push_back(letters[random() % (sizeof(letters) - 1U)]);
+	char suffix[24];
+	std::snprintf(suffix, sizeof(suffix), "-%zx", index);
+	return name.append(suffix).append(extensions[random() % std::size(extensions)]);
+}
+
+// Some time in the last three years
+struct timespec makeTime(std::mt19937& random)
+{
+	const std::time_t ago = random() % (3U * 365U * 86400U);
+	return {std::time(NULL) - ago, long(random() % 1000000000U)};
+}
+
+bool makeFile(std::mt19937& random, const int dirfd, const std::string& name)
+{
+	const int fd = openat(dirfd, name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if(fd < 0)
+		return false;
+	// Sparse, tmpfs only keeps the pages that were written
+	const off_t size = random() % 4U ? off_t(1U << (random() % 31U)) + random() % 1024U : 0;
+	const struct timespec times[2] = {makeTime(random), makeTime(random)};
+	const bool made = ftruncate(fd, size) == 0 && futimens(fd, times) == 0;
+	close(fd);
+	return made;
+}
+
+// `count` entries in `dirfd`: 80% files, 12% directories, 5% symlinks to an earlier entry and
+// 3% dangling ones. An eighth of the directories get a few files, every 256th a chain of
+// directories 32 deep with 2 files on every level
+bool makeTree(std::mt19937& random, const int dirfd, const size_t count)
+{
+	std::vector<std::string> names;
+	size_t directories = 0U;
+	for(size_t i = 0U; i < count; ++i)
+	{
+		const std::string name = makeName(random, i);
+		const unsigned int kind = random() % 100U;
+		const struct timespec times[2] = {makeTime(random), makeTime(random)};
+		bool made;
+		if(kind < 80U)
+			made = makeFile(random, dirfd, name);
+		else if(kind < 92U)
+		{
+			made = mkdirat(dirfd, name.c_str(), 0755) == 0;
+			const int subdir = made ? openat(dirfd, name.c_str(), O_DIRECTORY | O_CLOEXEC) : -1;
+			if(subdir >= 0 && random() % 8U == 0U)
+				for(unsigned int file = random() % 4U + 1U; file > 0U && made; --file)
+					made = makeFile(random, subdir, makeName(random, file));
+			if(subdir >= 0 && directories++ % 256U == 0U)
+			{
+				int level = dup(subdir);
+				for(unsigned int depth = 0U; depth < 32U && level >= 0 && made; ++depth)
+				{
+					const std::string inner = "level-" + std::to_string(depth);
+					made = makeFile(random, level, makeName(random, 0U)) &&
+						   makeFile(random, level, makeName(random, 1U)) &&
+						   mkdirat(level, inner.c_str(), 0755) == 0;
+					const int next = openat(level, inner.c_str(), O_DIRECTORY | O_CLOEXEC);
+					close(level);
+					level = next;
+				}
+				if(level >= 0)
+					close(level);
+			}
+			if(subdir >= 0)
+				close(subdir);
+			made = made && utimensat(dirfd, name.c_str(), times, 0) == 0;
+		}
+		else
+		{
+			const std::string target =
+				kind < 97U && !names.empty() ? names[random() % names.size()] : "missing-" + name;
+			made = symlinkat(target.c_str(), dirfd, name.c_str()) == 0 &&
+				   utimensat(dirfd, name.c_str(), times, AT_SYMLINK_NOFOLLOW) == 0;
+		}
+		if(!made)
+			return false;
+		names.push_back(name);
+	}
+	return true;
+}
+
+// `path` holds the tree of `count` entries, generated again unless it's already there and as
+// the current version made it
+bool prepareTree(const std::string& path, const size_t count, const bool fresh)
+{
+	const std::string ready = path + ".ready";
+	const std::string stamp = std::to_string(TREE_VERSION) + '\n';
+	char found[16] = {};
+	if(FILE* file = fresh ? nullptr : std::fopen(ready.c_str(), "r"))
+	{
+		const bool read = std::fgets(found, sizeof(found), file) != nullptr;
+		std::fclose(file);
+		if(read && stamp == found)
+			return true;
+	}
+
+	std::fprintf(stderr, "Generating %zu entries in %s\n", count, path.c_str());
+	unlink(ready.c_str());
+	nftw(
+		path.c_str(),
+		[](const char* entry, const struct stat*, int, struct FTW*) { return remove(entry); },
+		64,
+		FTW_DEPTH | FTW_PHYS);
+	if(mkdir(path.c_str(), 0755) != 0)
+		return false;
+	const int dirfd = open(path.c_str(), O_DIRECTORY | O_CLOEXEC);
+	std::mt19937 random(count);
+	const bool made = dirfd >= 0 && makeTree(random, dirfd, count);
+	if(dirfd >= 0)
+		close(dirfd);
+	FILE* file = made ? std::fopen(ready.c_str(), "w") : nullptr;
+	if(!file)
+		return false;
+	std::fputs(stamp.c_str(), file);
+	return std::fclose(file) == 0;
+}
+
+/// MEASURING
+
+using Clock = std::chrono::steady_clock;
+
+struct Samples
+{
+	std::vector<double> times;	  // Microseconds
+
+	void add(const Clock::time_point start)
+	{
+		times.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+	}
+	// The nearest rank
+	double percentile(const double fraction)
+	{
+		std::sort(times.begin(), times.end());
+		const size_t rank = size_t(std::ceil(fraction * times.size()));
+		return times[std::max<size_t>(rank, 1U) - 1U];
+	}
+};
+
+// Every directory the walk reads, waited for depth first as -R prints them. Returns the entries
+size_t waitAll(TreeWalker& walker, TreeNode& node)
+{
+	if(walker.wait(node) != TreeNode::listed)
+		return 0U;
+	size_t entries = node.table.size();
+	for(const auto& child: node.children)
+		entries += waitAll(walker, *child);
+	return entries;
+}
+
+struct Settings
+{
+	IoMode io_mode = IoMode::sync;
+	unsigned int jobs = 1U, walk_jobs = 1U;
+	size_t runs = 0U;	 // 0 to pick by size
+};
+
+// What the render phases printed, counted and hashed (FNV-1a) instead of written anywhere
+struct Printed
+{
+	size_t bytes = 0U;
+	uint64_t hash = 14695981039346656037ULL;
+
+	static void write(void* context, const char* data, const size_t size)
+	{
+		Printed& printed = *static_cast<Printed*>(context);
+		printed.bytes += size;
+		for(size_t i = 0U; i < size; ++i)
+			printed.hash = (printed.hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+	}
+};
+
+// The numbers in a comma separated list, 0s dropped
+std::vector<size_t> parseList(const std::string& list)
+{
+	std::vector<size_t> numbers;
+	for(const char* at = list.c_str(); *at;)
+	{
+		char* end;
+		if(const size_t number = std::strtoull(at, &end, 10))
+			numbers.push_back(number);
+		at = *end ? end + 1 : end;
+	}
+	return numbers;
+}
+
+// Runs the pipeline on `path` `runs` times after one that isn't counted, `walked` is how many
+// entries the walk saw and `hash` that of the -l output without colors (which would depend on
+// when it's printed)
+std::array<Samples, PHASE_COUNT> measure(const std::string& path, const size_t runs,
+										 const Settings& settings, size_t& walked, uint64_t& hash)
+{
+	std::array<Samples, PHASE_COUNT> phases;
+	const Theme& theme = selectTheme("always");
+	IdCache ids;
+	Options grid_opts, long_opts;
+	long_opts.long_list = true;
+	Printed grid_out, long_out;
+	WalkOptions walk;
+	walk.mask = sortMask(SortMode::name) | metaMask(false);
+	walk.jobs = settings.walk_jobs;
+
+	for(size_t run = 0U; run <= runs; ++run)
+	{
+		std::array<Samples, PHASE_COUNT> unused;
+		std::array<Samples, PHASE_COUNT>& samples = run ? phases : unused;
+
+		Clock::time_point start = Clock::now();
+		DirScanner scanner(path);
+		EntryTable table;
+		while(scanner.batch([&](const RawEntry* entry) {
+			if(entry->d_name[0] != '.')
+				table.add(entry->d_name, entry->d_type);
+		}))
+			;
+		samples[ENUMERATE].add(start);
+
+		start = Clock::now();
+		table.fetchMeta(settings.io_mode,
+						settings.jobs,
+						scanner.dirfd(),
+						metaMask(true) | sortMask(SortMode::name));
+		samples[METADATA].add(start);
+
+		start = Clock::now();
+		const std::vector<uint32_t> order = sortTable(table, SortMode::name, false);
+		samples[SORT].add(start);
+
+		start = Clock::now();
+		Summary summary;
+		summary.addNames(table);
+		summary.addMeta(table, ids, true);
+		OutBuf out(Sink {Printed::write, &grid_out});
+		Printer grid_printer(out, theme, ids, grid_opts, summary, 200U);
+		const GridLayout grid = grid_printer.plan(table, order);
+		samples[LAYOUT].add(start);
+
+		start = Clock::now();
+		grid_printer.print(table, order, grid);
+		out.flush();
+		samples[RENDER].add(start);
+
+		start = Clock::now();
+		OutBuf long_buffer(Sink {Printed::write, &long_out});
+		Printer long_printer(long_buffer, theme, ids, long_opts, summary, 200U);
+		long_printer.print(table, order);
+		long_printer.finish();
+		long_buffer.flush();
+		samples[RENDER_LONG].add(start);
+
+		if(run == runs)
+		{
+			Printed plain;
+			OutBuf plain_buffer(Sink {Printed::write, &plain});
+			const Theme& plain_theme = selectTheme("never");
+			Printer plain_printer(plain_buffer, plain_theme, ids, long_opts, summary, 200U);
+			plain_printer.print(table, order);
+			plain_printer.finish();
+			plain_buffer.flush();
+			hash = plain.hash;
+		}
+
+		start = Clock::now();
+		{
+			TreeWalker walker(path, walk);
+			walked = waitAll(walker, walker.root());
+		}
+		samples[WALK].add(start);
+	}
+	return phases;
+}
+
+/// COUNTING SYSCALLS
+
+// What enumerating and the metadata pass are made of, anything else only counts for the total
+constexpr struct
+{
+	long number;
+	const char* name;
+} counted_calls[] = {{SYS_getdents64, "getdents64"},
+					 {SYS_statx, "statx"},
+					 {SYS_newfstatat, "newfstatat"},
+#ifdef SYS_stat
+					 {SYS_stat, "stat"},
+					 {SYS_lstat, "lstat"},
+					 {SYS_readlink, "readlink"},
+#endif
+					 {SYS_fstat, "fstat"},
+					 {SYS_openat, "openat"},
+					 {SYS_io_uring_enter, "io_uring_enter"}};
+
+// Runs `argv` with its stdout thrown away and counts the syscalls of it and every thread it
+// starts, by number. `status` is how it ended, the counts are empty if it couldn't be traced
+std::map<long, size_t> countSyscalls(char* const* argv, int& status)
+{
+	std::map<long, size_t> counts;
+	const pid_t child = fork();
+	if(child == 0)
+	{
+		const int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		dup2(null, STDOUT_FILENO);
+		ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+		raise(SIGSTOP);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	status = -1;
+	if(child < 0 || waitpid(child, &status, 0) != child || !WIFSTOPPED(status))
+		return counts;
+	ptrace(PTRACE_SETOPTIONS,
+		   child,
+		   nullptr,
+		   PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+	ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+	int state;
+	for(pid_t thread; (thread = waitpid(-1, &state, __WALL)) >= 0;)
+	{
+		if(!WIFSTOPPED(state))
+		{
+			status = thread == child ? state : status;
+			continue;
+		}
+		int signal = 0;
+		if(WSTOPSIG(state) == (SIGTRAP | 0x80))
+		{
+			__ptrace_syscall_info info;
+			if(ptrace(PTRACE_GET_SYSCALL_INFO, thread, sizeof(info), &info) > 0 &&
+			   info.op == PTRACE_SYSCALL_INFO_ENTRY)
+				++counts[info.entry.nr];
+		}
+		// Clone events and new threads' first stops aren't signals to pass on
+		else if(WSTOPSIG(state) != SIGTRAP && WSTOPSIG(state) != SIGSTOP)
+			signal = WSTOPSIG(state);
+		ptrace(PTRACE_SYSCALL, thread, nullptr, signal);
+	}
+	return counts;
+}
+
+// `path` holds the tree of `count` entries, ready to run on. Says why not if it doesn't
+bool haveTree(const std::string& path, const size_t count, const bool fresh)
+{
+	if(prepareTree(path, count, fresh))
+		return true;
+	// tmpfs runs out of inodes long before it runs out of memory
+	std::fprintf(stderr,
+				 "Can't generate %s: %s%s\n",
+				 path.c_str(),
+				 std::strerror(errno),
+				 errno == ENOSPC ? " (see df -i, or pick another --root)" : "");
+	return false;
+}
+
+// --syscalls, every binary in `lists` plain and with -l on every tree
+int compareSyscalls(const std::vector<std::string>& lists, const std::string& root,
+					const std::vector<size_t>& sizes, const bool fresh)
+{
+	std::printf("{\n\t\"build\": \"%s\",\n\t\"syscalls\": [", BENCH_BUILD);
+	bool first = true, traced = true;
+	for(const size_t size: sizes)
+	{
+		const std::string path = root + '/' + std::to_string(size);
+		if(!haveTree(path, size, fresh))
+			return 2;
+		for(const std::string& list: lists)
+			for(const char* mode: {"", "-l"})
+			{
+				// --local keeps a running --serve out of it, older builds take it for nothing
+				std::vector<std::string> words {list, "--local"};
+				if(*mode)
+					words.emplace_back(mode);
+				words.push_back(path);
+				std::vector<char*> argv;
+				for(std::string& word: words)
+					argv.push_back(word.data());
+				argv.push_back(nullptr);
+
+				int status;
+				const std::map<long, size_t> counts = countSyscalls(argv.data(), status);
+				size_t total = 0U;
+				for(const auto& count: counts)
+					total += count.second;
+				const bool ran = total > 0U && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+				traced = traced && ran;
+				std::printf("%s\n\t\t{\"list\": \"%s\", \"entries\": %zu, \"args\": \"%s\", "
+							"\"ran\": %s",
+							first ? "" : ",",
+							list.c_str(),
+							size,
+							mode,
+							ran ? "true" : "false");
+				std::fprintf(stderr, "%s %s, %zu entries:", list.c_str(), mode, size);
+				first = false;
+				for(const auto& call: counted_calls)
+				{
+					const auto found = counts.find(call.number);
+					const size_t count = found == counts.end() ? 0U : found->second;
+					std::printf(", \"%s\": %zu", call.name, count);
+					if(count)
+						std::fprintf(stderr, " %s %zu", call.name, count);
+				}
+				std::printf(", \"total\": %zu}", total);
+				std::fprintf(stderr, " (%zu in all)%s\n", total, ran ? "" : " FAILED");
+				std::fflush(stdout);
+			}
+	}
+	std::printf("\n\t]\n}\n");
+	return traced ? 0 : 1;
+}
+
+/// CHECKING --mem-limit
+
+// Runs `argv` with its stdout going to `output`. `peak` is the most it had in memory, in KB.
+// That's VmHWM just before it exits: getrusage's ru_maxrss would count the copy of list_bench
+// it was forked from as well
+int runList(char* const* argv, const std::string& output, long& peak)
+{
+	const pid_t child = fork();
+	if(child == 0)
+	{
+		const int file = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(file < 0 || dup2(file, STDOUT_FILENO) < 0)
+			_exit(127);
+		ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+		raise(SIGSTOP);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	int status = -1;
+	if(child < 0 || waitpid(child, &status, 0) != child || !WIFSTOPPED(status))
+		return -1;
+	ptrace(PTRACE_SETOPTIONS, child, nullptr, PTRACE_O_TRACEEXIT | PTRACE_O_EXITKILL);
+	ptrace(PTRACE_CONT, child, nullptr, nullptr);
+	while(waitpid(child, &status, 0) == child && WIFSTOPPED(status))
+	{
+		int signal = 0;
+		if(status >> 8 == (SIGTRAP | PTRACE_EVENT_EXIT << 8))
+		{
+			const std::string path = "/proc/" + std::to_string(child) + "/status";
+			if(FILE* file = std::fopen(path.c_str(), "r"))
+			{
+				char line[256];
+				while(std::fgets(line, sizeof(line), file))
+					if(std::strncmp(line, "VmHWM:", 6U) == 0)
+						peak = std::strtol(line + 6, nullptr, 10);
+				std::fclose(file);
+			}
+		}
+		// The SIGTRAP after execv is ptrace's own
+		else if(WSTOPSIG(status) != SIGTRAP)
+			signal = WSTOPSIG(status);
+		ptrace(PTRACE_CONT, child, nullptr, signal);
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// The files at `first` and `second` hold the same bytes
+bool sameFiles(const std::string& first, const std::string& second)
+{
+	FILE* one = std::fopen(first.c_str(), "rb");
+	FILE* other = std::fopen(second.c_str(), "rb");
+	bool same = one && other;
+	std::array<char, 1 << 16> left, right;
+	while(same)
+	{
+		const size_t read = std::fread(left.data(), 1U, left.size(), one);
+		same = std::fread(right.data(), 1U, right.size(), other) == read &&
+			   std::memcmp(left.data(), right.data(), read) == 0;
+		if(read < left.size())
+			break;
+	}
+	if(one)
+		std::fclose(one);
+	if(other)
+		std::fclose(other);
+	return same;
+}
+
+// --check-mem-limit, `list` on every tree with and without --mem-limit=`limit`
+int checkMemLimit(const std::string& list, const std::string& limit, const std::string& root,
+				  const std::vector<size_t>& sizes, const bool fresh)
+{
+	const size_t limit_kb = parseSize(limit) >> 10U;
+	if(limit_kb == 0U)
+	{
+		std::fprintf(stderr, "Not a size: %s\n", limit.c_str());
+		return 2;
+	}
+	const auto run = [&](const std::string& path,
+						 const char* mode,
+						 const std::string& extra,
+						 const std::string& output,
+						 long& peak)
+	{
+		// Piped output is only sorted when a sort is asked for
+		std::vector<std::string> words {
+			list, "--local", "--color=never", "--sort=name", "--time-style=full-iso", mode, path};
+		if(!extra.empty())
+			words.push_back(extra);
+		std::vector<char*> argv;
+		for(std::string& word: words)
+			argv.push_back(word.data());
+		argv.push_back(nullptr);
+		return runList(argv.data(), output, peak);
+	};
+
+	// What list holds before it has read anything: the binary, libc, the buffers
+	const std::string empty = root + "/empty", scratch = root + "/mem-limit";
+	long overhead = 0;
+	mkdir(empty.c_str(), 0755);
+	if(run(empty, "-l", "", scratch, overhead) != 0)
+	{
+		std::fprintf(stderr, "Can't run %s\n", list.c_str());
+		return 2;
+	}
+	std::printf("{\n\t\"build\": \"%s\",\n\t\"mem_limit\": \"%s\",\n\t\"overhead_kb\": %ld,"
+				"\n\t\"runs\": [",
+				BENCH_BUILD,
+				limit.c_str(),
+				overhead);
+	bool first = true, passed = true;
+	for(const size_t size: sizes)
+	{
+		const std::string path = root + '/' + std::to_string(size);
+		if(!haveTree(path, size, fresh))
+			return 2;
+		for(const char* mode: {"-1", "-l"})
+		{
+			const std::string limited = scratch + mode + ".limited", whole = scratch + mode;
+			long limited_kb = 0, whole_kb = 0;
+			const int limited_exit = run(path, mode, "--mem-limit=" + limit, limited, limited_kb);
+			const int whole_exit = run(path, mode, "", whole, whole_kb);
+			const bool same = limited_exit == 0 && whole_exit == 0 && sameFiles(limited, whole);
+			// The getdents64 buffer, the spill's writes and a merge window per run come on top
+			const bool within = limited_kb <= overhead + static_cast<long>(limit_kb) + 4096L;
+			passed = passed && same && within;
+			std::printf("%s\n\t\t{\"entries\": %zu, \"args\": \"%s\", \"same\": %s, "
+						"\"limited_rss_kb\": %ld, \"whole_rss_kb\": %ld}",
+						first ? "" : ",",
+						size,
+						mode,
+						same ? "true" : "false",
+						limited_kb,
+						whole_kb);
+			std::fflush(stdout);
+			first = false;
+			std::fprintf(stderr,
+						 "%zu entries %s: peak RSS %ld KB with --mem-limit=%s, %ld KB without"
+						 "%s%s\n",
+						 size,
+						 mode,
+						 limited_kb,
+						 limit.c_str(),
+						 whole_kb,
+						 same ? "" : ", the outputs DIFFER",
+						 within ? "" : ", over the limit");
+			// Kept for diff when they don't match
+			if(same)
+			{
+				unlink(limited.c_str());
+				unlink(whole.c_str());
+			}
+		}
+	}
+	unlink(scratch.c_str());
+	std::printf("\n\t]\n}\n");
+	return passed ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	Args arg_parser(argc, argv);
+	arg_parser.convert();
+	if(arg_parser.optExists("--help", "-h"))
+	{
+		std::fprintf(stderr,
+					 "Usage: list_bench [--sizes=1000,100000,1000000] [--runs=N] [--root=DIR] "
+					 "[--fresh] [--io=sync|uring] [--jobs=N[,N...]] > results.json\n"
+					 "       list_bench --syscalls[=LIST,...] [--sizes=100000] [--root=DIR]\n"
+					 "       list_bench --check-mem-limit[=64M] [--sizes=10000000] [--root=DIR]\n");
+		return 1;
+	}
+	Settings settings;
+	settings.io_mode = arg_parser.getValue("--io") == "uring" ? IoMode::uring : IoMode::sync;
+	std::vector<size_t> job_counts = parseList(arg_parser.getValue("--jobs", "1"));
+	if(job_counts.empty())
+		job_counts.push_back(1U);
+	const bool walk_all_cores = arg_parser.getValue("--jobs").empty();
+	settings.runs = std::strtoull(arg_parser.getValue("--runs").c_str(), nullptr, 10);
+	const std::string root = arg_parser.getValue("--root", "/dev/shm/list-bench");
+	const bool fresh = arg_parser.optExists("--fresh");
+	const bool syscalls =
+		arg_parser.optExists("--syscalls") || !arg_parser.getValue("--syscalls").empty();
+	const bool check_mem_limit = arg_parser.optExists("--check-mem-limit") ||
+								 !arg_parser.getValue("--check-mem-limit").empty();
+	const std::vector<size_t> sizes =
+		parseList(arg_parser.getValue("--sizes",
+									  syscalls		  ? "100000"
+									  : check_mem_limit ? "10000000"
+														: "1000,100000,1000000"));
+
+	mkdir(root.c_str(), 0755);
+	struct statfs info;
+	if(statfs(root.c_str(), &info) != 0)
+	{
+		std::fprintf(stderr, "Can't use %s: %s\n", root.c_str(), std::strerror(errno));
+		return 2;
+	}
+	if(info.f_type != TMPFS_MAGIC)
+		std::fprintf(stderr, "%s isn't on tmpfs, the disk is measured too\n", root.c_str());
+
+	// The list next to list_bench unless it's told which
+	const std::string self(argv[0]);
+	const size_t slash = self.rfind('/');
+	const std::string sibling =
+		(slash == std::string::npos ? "." : self.substr(0U, slash)) + "/list";
+	if(check_mem_limit)
+		return checkMemLimit(
+			sibling, arg_parser.getValue("--check-mem-limit", "64M"), root, sizes, fresh);
+	if(syscalls)
+	{
+		std::vector<std::string> lists;
+		const std::string given = arg_parser.getValue("--syscalls", sibling);
+		for(size_t start = 0U, comma; start <= given.size(); start = comma + 1U)
+		{
+			comma = std::min(given.find(',', start), given.size());
+			if(comma > start)
+				lists.push_back(given.substr(start, comma - start));
+		}
+		return compareSyscalls(lists, root, sizes, fresh);
+	}
+
+	std::printf("{\n\t\"build\": \"%s\",\n\t\"compiler\": \"%s\",\n\t\"flags\": \"%s\",\n",
+				BENCH_BUILD,
+				__VERSION__,
+				BENCH_FLAGS);
+	std::printf("\t\"io\": \"%s\",\n\t\"trees\": [",
+				settings.io_mode == IoMode::uring ? "uring" : "sync");
+	std::fprintf(
+		stderr, "%10s %5s %12s %14s %14s\n", "entries", "jobs", "phase", "median us", "p99 us");
+	bool first = true, same = true;
+	for(size_t t = 0U; t < sizes.size(); ++t)
+	{
+		const std::string path = root + '/' + std::to_string(sizes[t]);
+		if(!haveTree(path, sizes[t], fresh))
+			return 2;
+		const size_t runs =
+			settings.runs ? settings.runs : std::clamp<size_t>(2000000U / sizes[t], 5U, 200U);
+		uint64_t first_hash = 0U;
+		for(const size_t jobs: job_counts)
+		{
+			settings.jobs = std::clamp<unsigned int>(jobs, 1U, 256U);
+			settings.walk_jobs =
+				walk_all_cores ? std::max(std::thread::hardware_concurrency(), 1U) : settings.jobs;
+			size_t walked = 0U;
+			uint64_t hash = 0U;
+			std::array<Samples, PHASE_COUNT> phases = measure(path, runs, settings, walked, hash);
+			// More threads mustn't change a byte of the listing
+			if(jobs != job_counts.front() && hash != first_hash)
+			{
+				std::fprintf(stderr, "%zu entries: -l differs with %zu jobs\n", sizes[t], jobs);
+				same = false;
+			}
+			first_hash = jobs == job_counts.front() ? hash : first_hash;
+
+			std::printf("%s\n\t\t{\n\t\t\t\"entries\": %zu,", first ? "" : ",", sizes[t]);
+			std::printf("\n\t\t\t\"jobs\": %u,\n\t\t\t\"walk_jobs\": %u,",
+						settings.jobs,
+						settings.walk_jobs);
+			std::printf("\n\t\t\t\"walked\": %zu,\n\t\t\t\"runs\": %zu,", walked, runs);
+			first = false;
+			for(unsigned int phase = 0U; phase < PHASE_COUNT; ++phase)
+			{
+				const double median = phases[phase].percentile(0.5);
+				const double p99 = phases[phase].percentile(0.99);
+				std::printf("\n\t\t\t\"%s\": {\"median_us\": %.1f, \"p99_us\": %.1f}%s",
+							phase_names[phase],
+							median,
+							p99,
+							phase + 1U < PHASE_COUNT ? "," : "");
+				std::fprintf(stderr,
+							 "%10zu %5u %12s %14.1f %14.1f\n",
+							 sizes[t],
+							 settings.jobs,
+							 phase_names[phase],
+							 median,
+							 p99);
+			}
+			std::printf("\n\t\t}");
+			std::fflush(stdout);
+		}
+	}
+	std::printf("\n\t]\n}\n");
+	return same ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Listings that have to come out the same as the plain one, run by `make test` on ../bin/list
+# (or the list given). A directory of random names, sizes and times is made in $TMPDIR, and
+# in every sort mode and reversed --top=N has to print the first N lines of the whole sorted
+# listing and --mem-limit, spilling a run every few dozen entries, the whole listing itself
+
+list=${1:-../bin/list}
+dir=$(mktemp -d) || exit 2
+trap 'rm -rf "$dir"' EXIT
+failures=0
+
+# 1300 entries: names of letters, digit runs (with leading zeros), dots and dashes in both cases,
+# some directories, a few sizes and times shared so the names have to break the ties
+awk 'BEGIN {
+	srand(21)
+	split("a b C d E q w Y z 0 00 7 9 10 168 007 99999 . - _ .txt .TXT .tar.gz", pieces, " ")
+	while(made < 1300)
+	{
+		name = ""
+		for(piece = int(rand() * 4) + 1; piece > 0; --piece)
+			name = name pieces[int(rand() * 22) + 1]
+		if(name == "." || name == ".." || name in seen)
+			continue
+		seen[name] = 1
+		++made
+		if(rand() < 0.1)
+			printf "mkdir -- \"%s\"\n", name
+		else
+			printf "head -c %d /dev/zero > \"%s\"\n", int(rand() * 8) * 100, name
+		printf "touch -d @%d -- \"%s\"\n", 1600000000 + int(rand() * 6) * 86400, name
+	}
+}' | (cd "$dir" && sh) || exit 2
+
+for sort in name size time extension none; do
+	for reverse in "" -r; do
+		for count in 1 37 500 1300; do
+			options="--local --color=never -1 -a --sort=$sort $reverse"
+			# shellcheck disable=SC2086
+			whole=$("$list" $options "$dir" | head -n "$count")
+			# shellcheck disable=SC2086
+			top=$("$list" $options --top="$count" "$dir")
+			if [ "$whole" != "$top" ]; then
+				echo "list $options --top=$count isn't the first $count lines without --top"
+				failures=$((failures + 1))
+			fi
+		done
+	done
+done
+
+for sort in name size time extension; do
+	for reverse in "" -r; do
+		for format in -1 -l; do
+			options="--local --color=never --time-style=full-iso -a $format --sort=$sort $reverse"
+			# shellcheck disable=SC2086
+			whole=$("$list" $options "$dir")
+			# shellcheck disable=SC2086
+			spilled=$("$list" $options --mem-limit=4K "$dir")
+			if [ "$whole" != "$spilled" ]; then
+				echo "list $options --mem-limit=4K isn't the same listing as without it"
+				failures=$((failures + 1))
+			fi
+		done
+	done
+done
+
+[ "$failures" -eq 0 ] || echo "list_test: $failures failures"
+[ "$failures" -eq 0 ]
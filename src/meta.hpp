@@ -0,0 +1,81 @@
+#ifndef META_HPP
+#define META_HPP
+
+// Everything we show about a file comes from a single statx call, and the kernel is only
+// asked for the fields the current output mode actually prints
+
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+struct FileMeta
+{
+	unsigned int mask = 0U;	   // STATX_* fields that were filled in
+	uint32_t mode = 0U;
+	uint32_t uid = 0U, gid = 0U;
+	uint64_t ino = 0ULL;
+	// Size as listed, regular files (or links to them) have their size, links to directories
+	// 4096 and everything else 0
+	uint64_t size = 0ULL;
+	uint64_t blocks = 0ULL;	   // 512 byte blocks of the entry itself, only with STATX_BLOCKS
+	int64_t mtime = 0;
+	uint32_t mtime_nsec = 0U;
+	// Follows symlinks, a link to a directory is listed as a directory
+	bool is_dir = false;
+};
+
+// The grid only needs names (and d_type), the long listing needs everything
+constexpr unsigned int META_NAMES = 0U;
+constexpr unsigned int META_LONG =
+	STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_INO | STATX_SIZE | STATX_MTIME;
+
+// Not a statx field, set in `mask` when `size` is a --du total rather than the entry's own
+constexpr unsigned int META_TOTAL = 0x80000000U;
+
+// -h only changes how sizes are printed, and sizes are only printed in the long listing
+inline unsigned int metaMask(const bool long_list) { return long_list ? META_LONG : META_NAMES; }
+
+// Turn a statx result into a FileMeta, `target` is the followed statx for symlinks
+inline void fillMeta(const struct statx& stx, const struct statx* target, FileMeta& meta)
+{
+	meta.mask = stx.stx_mask;
+	meta.mode = stx.stx_mode;
+	meta.uid = stx.stx_uid;
+	meta.gid = stx.stx_gid;
+	meta.ino = stx.stx_ino;
+	meta.blocks = stx.stx_blocks;
+	meta.mtime = stx.stx_mtime.tv_sec;
+	meta.mtime_nsec = stx.stx_mtime.tv_nsec;
+
+	const uint32_t type = (target ? target->stx_mode : stx.stx_mode) & S_IFMT;
+	meta.is_dir = type == S_IFDIR;
+	if(type == S_IFREG)
+		meta.size = target ? target->stx_size : stx.stx_size;
+	else
+		meta.size = (meta.is_dir && target) ? 4096ULL : 0ULL;
+}
+
+// One statx for the entry itself, plus one for where it points to if it's a symlink
+inline bool fetchMeta(int dirfd, const char* name, const unsigned int mask, FileMeta& meta)
+{
+	struct statx stx, target;
+	if(statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask | STATX_TYPE, &stx) != 0)
+		return false;
+
+	const bool followed = S_ISLNK(stx.stx_mode) &&
+						  statx(dirfd, name, AT_NO_AUTOMOUNT, STATX_TYPE | STATX_SIZE, &target) == 0;
+	fillMeta(stx, followed ? &target : nullptr, meta);
+	return true;
+}
+
+// The plain one-after-another metadata pass, `name(i)` returns nullptr for entries that don't
+// need a stat and `meta(i)` is where the result goes
+template<typename Name, typename Meta>
+void fetchMetaSync(int dirfd, const size_t count, const unsigned int mask, Name&& name, Meta&& meta)
+{
+	for(size_t i = 0U; i < count; ++i)
+		if(const char* file = name(i))
+			fetchMeta(dirfd, file, mask, meta(i));
+}
+
+#endif
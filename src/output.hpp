@@ -0,0 +1,168 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+// Everything that gets printed goes through one reusable buffer which is handed to write()
+// whenever it fills up, instead of building a std::string per entry and pushing it through
+// std::cout and its manipulators
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+// Writes the decimal digits of `value` to `out` (at least 20 bytes), returns how many
+inline size_t toChars(char* out, uint64_t value)
+{
+	char digits[20];
+	char* end = digits + sizeof(digits);
+	char* begin = end;
+	do
+	{
+		*--begin = '0' + value % 10U;
+		value /= 10U;
+	} while(value);
+	std::memcpy(out, begin, end - begin);
+	return end - begin;
+}
+
+// Where a buffer goes instead of an fd, for programs using liblist. `write` is handed the
+// buffered bytes in place every time it fills up, and once more at the end
+struct Sink
+{
+	void (*write)(void* context, const char* data, size_t size) = nullptr;
+	void* context = nullptr;
+};
+
+class OutBuf
+{
+private:
+	const int fd;
+	const Sink sink;
+	const size_t capacity;
+	std::unique_ptr<char[]> data;
+	size_t used;
+
+	// Room for `size` more bytes, anything bigger than the whole buffer goes out directly
+	void reserve(const size_t size)
+	{
+		if(used + size > capacity)
+			flush();
+	}
+
+public:
+	explicit OutBuf(const int out_fd = STDOUT_FILENO, const size_t buffer_size = 256U * 1024U) :
+		fd(out_fd), capacity(buffer_size), data(new char[buffer_size]), used(0U)
+	{
+	}
+	explicit OutBuf(const Sink& to, const size_t buffer_size = 256U * 1024U) :
+		fd(-1), sink(to), capacity(buffer_size), data(new char[buffer_size]), used(0U)
+	{
+	}
+	OutBuf(const OutBuf&) = delete;
+	OutBuf& operator=(const OutBuf&) = delete;
+	~OutBuf() { flush(); }
+
+	void flush()
+	{
+		if(sink.write)
+		{
+			if(used > 0U)
+				sink.write(sink.context, data.get(), used);
+			used = 0U;
+			return;
+		}
+		const char* begin = data.get();
+		while(used > 0U)
+		{
+			const ssize_t written = write(fd, begin, used);
+			if(written < 0 && errno == EINTR)
+				continue;
+			// Nowhere to put it (closed pipe etc.), drop it
+			if(written <= 0)
+				break;
+			begin += written;
+			used -= written;
+		}
+		used = 0U;
+	}
+
+	OutBuf& append(const char* str, const size_t size)
+	{
+		if(size > capacity)
+		{
+			flush();
+			if(sink.write)
+			{
+				sink.write(sink.context, str, size);
+				return *this;
+			}
+			for(size_t done = 0U; done < size;)
+			{
+				const ssize_t written = write(fd, str + done, size - done);
+				if(written < 0 && errno == EINTR)
+					continue;
+				if(written <= 0)
+					break;
+				done += written;
+			}
+			return *this;
+		}
+		reserve(size);
+		std::memcpy(data.get() + used, str, size);
+		used += size;
+		return *this;
+	}
+
+	OutBuf& append(const std::string_view str) { return append(str.data(), str.size()); }
+
+	OutBuf& put(const char c)
+	{
+		reserve(1U);
+		data[used++] = c;
+		return *this;
+	}
+
+	// Same as `std::setw(width) << ' '`, at least one space
+	OutBuf& pad(const long width)
+	{
+		const size_t count = width > 1 ? width : 1U;
+		if(count > capacity)
+			return append(std::string(count, ' '));
+		reserve(count);
+		std::memset(data.get() + used, ' ', count);
+		used += count;
+		return *this;
+	}
+
+	OutBuf& number(const uint64_t value)
+	{
+		reserve(20U);
+		used += toChars(data.get() + used, value);
+		return *this;
+	}
+
+	// Hands `writer` room for `size` bytes in place, it returns how many it wrote
+	template<typename Writer>
+	OutBuf& fill(const size_t size, Writer&& writer)
+	{
+		reserve(size);
+		used += writer(data.get() + used);
+		return *this;
+	}
+};
+
+inline size_t digitCount(uint64_t value)
+{
+	size_t count = 1U;
+	while(value >= 10U)
+	{
+		value /= 10U;
+		++count;
+	}
+	return count;
+}
+
+#endif
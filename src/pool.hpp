@@ -0,0 +1,145 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+// A tiny fork/join pool for the metadata pass. Workers claim chunks of the (already sized)
+// entry array with an atomic counter and only ever write to the slots they claimed, so there
+// are no locks and nothing to merge afterwards.
+// And a work stealing pool for the recursive walk, where every task can make more of them
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs fn(begin, end) over [0, count) in chunks, on `jobs` threads (the caller is one of them)
+// and returns once every chunk is done
+template<typename Fn>
+void parallelChunks(const unsigned int jobs, const size_t count, const size_t chunk, Fn&& fn)
+{
+	if(jobs <= 1U || count <= chunk)
+	{
+		fn(size_t(0U), count);
+		return;
+	}
+
+	std::atomic<size_t> next(0U);
+	auto worker = [&]() {
+		for(size_t begin = next.fetch_add(chunk); begin < count; begin = next.fetch_add(chunk))
+			fn(begin, std::min(begin + chunk, count));
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(jobs - 1U);
+	for(unsigned int i = 1U; i < jobs; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for(std::thread& thread: threads)
+		thread.join();
+}
+
+// Each worker keeps its own deque and works on the newest task in it, so a walk goes depth
+// first and stays close to what it just read. Workers that run out take the oldest task of
+// another worker, the one most likely to make a lot of work of its own. The deques are only
+// locked for the push or pop, which is nothing next to a directory read
+template<typename Task>
+class StealingPool
+{
+private:
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	const unsigned int jobs;
+	std::unique_ptr<Queue[]> queues;
+	std::atomic<size_t> queued, pending;	// In the deques, in the deques or running
+	std::mutex idle_lock;
+	std::condition_variable idle;
+	std::vector<std::thread> threads;
+
+	bool take(const unsigned int worker, Task& task)
+	{
+		for(unsigned int i = 0U; i < jobs; ++i)
+		{
+			Queue& queue = queues[(worker + i) % jobs];
+			std::lock_guard<std::mutex> guard(queue.lock);
+			if(queue.tasks.empty())
+				continue;
+			if(i == 0U)
+			{
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+			--queued;
+			return true;
+		}
+		return false;
+	}
+
+public:
+	explicit StealingPool(const unsigned int workers) :
+		jobs(std::max(workers, 1U)), queues(new Queue[jobs]), queued(0U), pending(0U)
+	{
+	}
+	StealingPool(const StealingPool&) = delete;
+	StealingPool& operator=(const StealingPool&) = delete;
+	~StealingPool() { join(); }
+
+	// From a task running on `worker` (or before start()), onto that worker's deque
+	void push(const unsigned int worker, Task task)
+	{
+		++pending;
+		++queued;
+		{
+			std::lock_guard<std::mutex> guard(queues[worker % jobs].lock);
+			queues[worker % jobs].tasks.push_back(std::move(task));
+		}
+		std::lock_guard<std::mutex> guard(idle_lock);
+		idle.notify_one();
+	}
+
+	// Runs fn(task, worker) on `jobs` threads until there are no tasks left, doesn't wait
+	template<typename Fn>
+	void start(Fn fn)
+	{
+		for(unsigned int worker = 0U; worker < jobs; ++worker)
+			threads.emplace_back([this, fn, worker]() mutable {
+				for(Task task;;)
+				{
+					if(take(worker, task))
+					{
+						fn(task, worker);
+						if(--pending == 0U)
+						{
+							std::lock_guard<std::mutex> guard(idle_lock);
+							idle.notify_all();
+						}
+						continue;
+					}
+					std::unique_lock<std::mutex> lock(idle_lock);
+					idle.wait(lock, [this]() { return pending == 0U || queued > 0U; });
+					if(pending == 0U)
+						return;
+				}
+			});
+	}
+
+	void join()
+	{
+		for(std::thread& thread: threads)
+			thread.join();
+		threads.clear();
+	}
+};
+
+#endif
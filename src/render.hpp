@@ -0,0 +1,389 @@
+#ifndef RENDER_HPP
+#define RENDER_HPP
+
+// Turning a table into text, the entry formatting, the long listing and the column layout.
+// Shared by list itself and liblist
+
+#include "icons.hpp"
+#include "idcache.hpp"
+#include "layout.hpp"
+#include "meta.hpp"
+#include "output.hpp"
+#include "sortkey.hpp"
+#include "table.hpp"
+#include "theme.hpp"
+#include "timefmt.hpp"
+#include "uring.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+#define DAY	 86400U	   // Day in seconds
+#define HOUR 3600U	   // Hour in seconds
+
+// Human Readable File Sizes, written into `buff` (at least 21 bytes), returns the length
+inline size_t humane(char* buff, const uint64_t size)
+{
+	const char unit = size >= 1000000000U ? 'G' : size >= 1000000U ? 'M' : size >= 1000U ? 'K' : 'B';
+	const uint64_t value = unit == 'G'	 ? size / 1000000000U
+						   : unit == 'M' ? size / 1000000U
+						   : unit == 'K' ? size / 1000U
+										 : size;
+	const size_t length = toChars(buff, value);
+	buff[length] = unit;
+	return length + 1U;
+}
+
+// One entry of the table, with the bits of it that get printed
+class File
+{
+private:
+	const EntryTable& table;
+	const uint32_t index;
+
+public:
+	File(const EntryTable& entries, const uint32_t i) : table(entries), index(i) {}
+
+	std::string_view name() const { return table.name(index); }
+	const FileMeta& meta() const { return table.meta(index); }
+
+	void render(OutBuf& out, const Theme& theme) const
+	{
+		const uint16_t icon = table.icon(index);
+		if(table.isDir(index))
+			out.append(theme[DIRECTORY])
+				.append(icon == NO_ICON ? "\ue5fe " : icon_list[icon].second)
+				.append(this->name())
+				.put('/')
+				.append(theme[RESET]);
+		else
+			out.append(theme[FILE_NAME])
+				.append(icon == NO_ICON ? "\uf15b " : icon_list[icon].second)
+				.append(this->name())
+				.append(theme[RESET])
+				.put(' ');
+	}
+
+	// Columns the icon and the name take
+	size_t width() const { return iconWidth(table.icon(index)) + table.width(index); }
+
+	// --git's marker and a space, nothing when the table has no statuses
+	void renderStatus(OutBuf& out, const Theme& theme) const
+	{
+		if(!table.hasStatus())
+			return;
+		const char status = table.status(index);
+		if(status == ' ')
+			out.append("  ", 2U);
+		else
+			out.append(theme[status == 'M'   ? GIT_MODIFIED
+							 : status == '?' ? GIT_UNTRACKED
+							 : status == '!' ? GIT_IGNORED
+											 : GIT_CONFLICT])
+				.put(status)
+				.append(theme[RESET])
+				.put(' ');
+	}
+
+	// Writes the listed size into `buff` (at least 21 bytes), returns the length
+	size_t inline size(char* buff, const bool& human_readable = false) const
+	{
+		// Directories are 4096 unless --du put their total in
+		const uint64_t bytes =
+			table.isDir(index) && !(this->meta().mask & META_TOTAL) ? 4096U : this->meta().size;
+		return human_readable ? humane(buff, bytes) : toChars(buff, bytes);
+	}
+
+	void getPerms(OutBuf& out, const Theme& theme) const
+	{
+		// rwx for owner, group and others, from the highest bit down
+		for(int bit = 8; bit >= 0; --bit)
+		{
+			if(!(this->meta().mode & (1U << bit)))
+				out.append(theme[PERM_NONE]).put('-');
+			else if(bit % 3 == 2)
+				out.append(theme[PERM_READ]).put('r');
+			else if(bit % 3 == 1)
+				out.append(theme[PERM_WRITE]).put('w');
+			else
+				out.append(theme[PERM_EXEC]).put('x');
+		}
+		out.append(theme[RESET]).put(' ');
+	}
+};
+
+// One line of the long listing
+inline void printLong(OutBuf& out, const Theme& theme, const File& item, IdCache& ids,
+					  const char* indent, const size_t user_width, const size_t group_width,
+					  const size_t size_width, const bool human_readable, TimeFormat& times)
+{
+	char size[24U];
+	const size_t size_length = item.size(size, human_readable);
+
+	const std::string& uname = ids.user(item.meta().uid);		  // Owner-User
+	const std::string& group = ids.group(item.meta().gid);	  // Owner-Group
+	const std::time_t modify = item.meta().mtime;			  // Last Modified Time
+
+	item.getPerms(out.append(indent), theme);
+	out.pad(long(user_width) - long(uname.length()) + 1)
+		.append(uname)
+		.append(theme[RESET])
+		.put(' ');
+	out.pad(long(group_width) - long(group.length()) + 1)
+		.append(theme[GROUP])
+		.append(group)
+		.append(theme[RESET]);
+	out.pad(long(size_width) - long(size_length) + 1);
+
+	// Size Colors
+	if(item.meta().size < 1000000ULL)	   // item < 1 MB
+		out.append(theme[SIZE_TINY]);
+	else if(item.meta().size < 128000000ULL)	  // item < 128MB
+		out.append(theme[SIZE_SMALL]);
+	else if(item.meta().size < 512000000ULL)	  // item < 512MB
+		out.append(theme[SIZE_MEDIUM]);
+	else if(item.meta().size < 1000000000ULL)	   // item < 1GB
+		out.append(theme[SIZE_LARGE]);
+	else
+		out.append(theme[SIZE_HUGE]);
+	out.append(size, size_length).append(theme[RESET]).append("  ", 2U);
+
+	// FIXME fix the blue colors, too
+	// similar
+
+	// Set the color of the Modification
+	// Time, 3 Days -> 1 Day -> 6 Hours ->
+	// 1 Hour
+	const std::time_t diff = times.now() - modify;
+	if(diff > 3 * DAY)
+		out.append(theme[TIME_OLD]);
+	else if(diff > DAY && diff < 3 * DAY)
+		out.append(theme[TIME_DAYS]);
+	else if(diff < DAY && diff > 6 * HOUR)
+		out.append(theme[TIME_TODAY]);
+	else if(diff < 6 * HOUR && diff > HOUR)
+		out.append(theme[TIME_HOURS]);
+	else
+		out.append(theme[TIME_RECENT]);
+	out.fill(TimeFormat::MAX_SIZE, [&](char* at) {
+		return times.format(at, modify, item.meta().mtime_nsec);
+	});
+	out.append(theme[RESET]).append("  ", 2U);
+
+	item.renderStatus(out, theme);
+	item.render(out, theme);
+	out.put('\n');
+}
+
+// What was asked for on the command line
+struct Options
+{
+	bool show_all = false, long_list = false, human_readable = false, one_line = false,
+		 reverse = false;
+	SortMode sort_mode = SortMode::name;
+	IoMode io_mode = IoMode::sync;
+	unsigned int jobs = 1U;
+	size_t mem_limit = 0U;	  // Bytes, 0 for no limit
+	// -R, --tree[=DEPTH], -x and --max-fds
+	bool recursive = false, tree = false, one_filesystem = false;
+	unsigned int depth = UINT_MAX, max_handles = 256U;
+	// --du[=apparent|disk]
+	bool du = false, du_disk = false;
+	bool cache = false;
+	bool watch = false;
+	bool git = false;
+	size_t top = 0U;	// --top=N, 0 for every entry
+	TimeStyle time_style = TimeStyle::classic;
+};
+
+// What the layout is worked out from, gathered over the whole listing before printing
+struct Summary
+{
+	// Name widths are in columns and count the icon in front
+	size_t count = 0U, name_width = 0U, max_width = 0U, user_width = 0U, group_width = 0U;
+	size_t status_width = 0U;	 // --git's markers in front of the names
+	uint64_t largest_size = 1ULL;
+
+	void addNames(const EntryTable& table)
+	{
+		for(uint32_t i = 0U; i < table.size(); ++i)
+		{
+			const size_t width = File(table, i).width();
+			max_width = std::max(max_width, width);
+			name_width += width;
+		}
+		count += table.size();
+		if(table.hasStatus())
+			status_width = 2U;
+	}
+
+	// Sizes, and for -l the owners, once the table's metadata is in
+	void addMeta(const EntryTable& table, IdCache& ids, const bool long_list)
+	{
+		if(table.hasMeta())
+			for(size_t i = 0U; i < table.size(); ++i)
+				largest_size = std::max(largest_size, table.meta(i).size);
+		// Owner columns are as wide as the longest name that's actually in them
+		if(long_list)
+			for(size_t i = 0U; i < table.size(); ++i)
+			{
+				user_width = std::max(user_width, ids.user(table.meta(i).uid).length());
+				group_width = std::max(group_width, ids.group(table.meta(i).gid).length());
+			}
+	}
+};
+
+// Prints a listing one entry at a time, in its final order. The layout only depends on the
+// summary, so the entries can come from anywhere (the table, the merged runs of --mem-limit).
+// Those print rows as wide as the widest entry, a whole table at once gets the grid instead
+class Printer
+{
+private:
+	enum class Layout
+	{
+		long_list,
+		one_line,
+		rows,
+		single_row
+	};
+
+	OutBuf& out;
+	const Theme& theme;
+	IdCache& ids;
+	const Options& opts;
+	const Summary summary;
+	Layout layout;
+	const unsigned short term_width;
+	size_t cols, size_width, printed;
+	TimeFormat times;
+
+public:
+	Printer(OutBuf& output, const Theme& colors, IdCache& id_cache, const Options& options,
+			const Summary& listing, const unsigned short term_columns) :
+		out(output),
+		theme(colors),
+		ids(id_cache),
+		opts(options),
+		summary(listing),
+		term_width(term_columns),
+		cols(term_columns / (listing.max_width + 6U + listing.status_width)),
+		size_width(options.human_readable ? 4U : digitCount(listing.largest_size)),
+		printed(0U),
+		times(options.time_style, std::time(NULL))
+	{
+		// Find the number of columns and rows to display in the Terminal
+		const bool long_filename = cols == 0U;
+		size_t rows = long_filename ? 0U : summary.count / cols;
+		// Determine if every file/dir name combined with spaces can fit in a single row. 6U
+		// because of the occasional '/' and the space after it
+		if(4U + summary.name_width + (6U + summary.status_width) * summary.count >= term_width)
+			++rows;
+
+		if(opts.long_list)	  // -l option
+			layout = Layout::long_list;
+		// If max_width > term_width, if the longest string doesn't fit print a file on new
+		// lines
+		else if((long_filename && rows == 1U) || opts.one_line)
+			layout = Layout::one_line;
+		else if(rows > 1U)
+			layout = Layout::rows;
+		else
+			layout = Layout::single_row;
+	}
+
+	void print(const File& item)
+	{
+		switch(layout)
+		{
+			case Layout::long_list:
+				printLong(out,
+						  theme,
+						  item,
+						  ids,
+						  "  ",
+						  summary.user_width,
+						  summary.group_width,
+						  size_width,
+						  opts.human_readable,
+						  times);
+				break;
+			case Layout::one_line:
+				item.renderStatus(out.append("    ", 4U), theme);
+				item.render(out, theme);
+				out.put('\n');
+				break;
+			// Every column is as wide as the longest name
+			case Layout::rows:
+				if(printed % cols == 0U)
+					out.append("    ", 4U);
+				item.renderStatus(out, theme);
+				item.render(out, theme);
+				out.pad(long(summary.max_width) - long(item.width()) + 4);
+				if(printed % cols == cols - 1U)
+					out.put('\n');
+				break;
+			case Layout::single_row:
+				if(printed == 0U)
+					out.append("    ", 4U);
+				else
+					out.pad(4);
+				item.renderStatus(out, theme);
+				item.render(out, theme);
+				break;
+		}
+		++printed;
+	}
+
+	// The densest grid for `order` with a width per column, see layout.hpp
+	GridLayout plan(const EntryTable& table, const std::vector<uint32_t>& order) const
+	{
+		std::vector<uint16_t> widths(order.size());
+		for(size_t k = 0U; k < order.size(); ++k)
+			widths[k] = File(table, order[k]).width();
+		// The '/' or space behind every name and the --git markers in front
+		const size_t extra = 1U + summary.status_width;
+		return planGrid(RangeMax(std::move(widths)), extra, 4U, 4U, term_width);
+	}
+
+	// All of `order` at once, in `grid`
+	void print(const EntryTable& table, const std::vector<uint32_t>& order, const GridLayout& grid)
+	{
+		for(size_t row = 0U; row < grid.rows; ++row)
+		{
+			out.append("    ", 4U);
+			for(size_t k = row, col = 0U; k < order.size(); k += grid.rows, ++col)
+			{
+				const File item(table, order[k]);
+				item.renderStatus(out, theme);
+				item.render(out, theme);
+				if(k + grid.rows < order.size())
+					out.pad(long(grid.widths[col]) - long(item.width()) + 4);
+			}
+			out.put('\n');
+		}
+	}
+
+	// All of `order` at once, in the grid unless it's -l or -1
+	void print(const EntryTable& table, const std::vector<uint32_t>& order)
+	{
+		if(layout == Layout::long_list || layout == Layout::one_line)
+			for(const uint32_t i: order)
+				print(File(table, i));
+		else
+			print(table, order, plan(table, order));
+	}
+
+	// Ends the last row
+	void finish()
+	{
+		if((layout == Layout::rows && printed % cols != 0U) ||
+		   (layout == Layout::single_row && printed > 0U))
+			out.put('\n');
+	}
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+// Directory enumeration straight from getdents64, one big buffer per syscall instead of
+// std::filesystem::directory_iterator + a handful of stat calls for every entry
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// glibc's dirent64 has the exact layout of the kernel's linux_dirent64
+using RawEntry = struct dirent64;
+
+class DirScanner
+{
+private:
+	int fd;
+	int failure;	// errno of the open or of a getdents64 that failed, 0 until then
+	std::unique_ptr<char[]> buffer;
+	const size_t capacity;
+	long filled, offset;
+
+public:
+	// 256K fits ~8000 average sized entries, so a 100K entry directory is ~13 syscalls
+	explicit DirScanner(const std::string& path, size_t buffer_size = 256U * 1024U) :
+		fd(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)),
+		failure(fd < 0 ? errno : 0),
+		buffer(new char[buffer_size]),
+		capacity(buffer_size),
+		filled(0),
+		offset(0)
+	{
+	}
+	// `path` relative to the directory `at` (or AT_FDCWD), symlinks aren't followed
+	DirScanner(const int at, const std::string& path, size_t buffer_size = 256U * 1024U) :
+		fd(openat(at, path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)),
+		failure(fd < 0 ? errno : 0),
+		buffer(new char[buffer_size]),
+		capacity(buffer_size),
+		filled(0),
+		offset(0)
+	{
+	}
+	DirScanner(const DirScanner&) = delete;
+	DirScanner& operator=(const DirScanner&) = delete;
+	~DirScanner()
+	{
+		if(fd >= 0)
+			close(fd);
+	}
+
+	bool good() const { return fd >= 0 && failure == 0; }
+	// Why the directory couldn't be opened or read to the end, 0 if it could
+	int error() const { return failure; }
+	int dirfd() const { return fd; }
+	// Hands the descriptor over to the caller, who closes it
+	int release()
+	{
+		const int released = fd;
+		fd = -1;
+		return released;
+	}
+
+	// Returns the next entry, skipping '.' and '..', nullptr when the directory is exhausted or
+	// couldn't be read (see error())
+	const RawEntry* next()
+	{
+		while(fd >= 0 && failure == 0)
+		{
+			if(offset >= filled)
+			{
+				filled = syscall(SYS_getdents64, fd, buffer.get(), capacity);
+				offset = 0;
+				if(filled < 0)
+					failure = errno;
+				if(filled <= 0)
+					return nullptr;
+			}
+
+			const RawEntry* entry = reinterpret_cast<const RawEntry*>(buffer.get() + offset);
+			offset += entry->d_reclen;
+
+			const char* name = entry->d_name;
+			if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+				continue;
+			return entry;
+		}
+		return nullptr;
+	}
+
+	// Reads one buffer's worth of entries and calls fn() for each (except '.' and '..'),
+	// returns false once the directory is exhausted or couldn't be read (see error())
+	template<typename Fn>
+	bool batch(Fn&& fn)
+	{
+		filled = fd >= 0 && failure == 0 ? syscall(SYS_getdents64, fd, buffer.get(), capacity) : 0;
+		offset = 0;
+		if(filled < 0)
+			failure = errno;
+		if(filled <= 0)
+			return false;
+		while(offset < filled)
+		{
+			const RawEntry* entry = reinterpret_cast<const RawEntry*>(buffer.get() + offset);
+			offset += entry->d_reclen;
+			const char* name = entry->d_name;
+			if(!(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))))
+				fn(entry);
+		}
+		return true;
+	}
+};
+
+// Only stat when getdents couldn't tell us enough, DT_UNKNOWN (some filesystems never fill
+// d_type), symlinks (we need to know where they go) or when the caller needs metadata
+inline bool needsStat(const unsigned char type, const bool need_meta)
+{
+	return need_meta || type == DT_UNKNOWN || type == DT_LNK;
+}
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+// --serve, one resident process that does the listings of every `list` run, so they skip
+// process startup, loading NSS and resolving owners, and --cache tables stay in memory between
+// them. A client connects to a Unix socket and sends its arguments, a few environment
+// variables and three descriptors: its working directory, stdout and stderr. The server
+// changes into the directory, writes the listing straight into the client's stdout (so
+// isatty() and the terminal width are the client's) and answers with the exit code.
+// Requests are handled one at a time, a client that doesn't send its request within a second is
+// dropped so it can't hold up the rest. Runs only look for a server with $LIST_SERVER set,
+// without it (or with no server to talk to) they list by themselves and don't pay a connect()
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// What a listing reads from the environment, forwarded with every request: the colors, the
+// time zone -l's times are in, where --mem-limit spills, where --cache keeps its files and
+// where --git finds the global excludes
+constexpr const char* FORWARDED_ENV[] = {
+	"NO_COLOR", "TZ", "TMPDIR", "XDG_CACHE_HOME", "XDG_CONFIG_HOME", "HOME"};
+constexpr size_t REQUEST_MAX = 64U * 1024U;
+
+// Whether the other end of `sock` runs as the same user, nobody else gets our descriptors
+inline bool sameUser(const int sock)
+{
+	ucred peer;
+	socklen_t length = sizeof(peer);
+	return getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0 && peer.uid == getuid();
+}
+
+// $XDG_RUNTIME_DIR/list.sock, or one per user in /tmp
+inline std::string socketPath()
+{
+	const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+	if(runtime && *runtime == '/')
+		return std::string(runtime) + "/list.sock";
+	return "/tmp/list-" + std::to_string(getuid()) + ".sock";
+}
+
+inline bool socketAddress(sockaddr_un& address)
+{
+	const std::string path = socketPath();
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(path.size() >= sizeof(address.sun_path))
+		return false;
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1U);
+	return true;
+}
+
+// A socket connected to the server, -1 when there's none
+inline int connectServer()
+{
+	sockaddr_un address;
+	if(!socketAddress(address))
+		return -1;
+	const int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if(sock < 0)
+		return -1;
+	if(connect(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+	   !sameUser(sock))
+	{
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+// Hands the run over to a server, returns its exit code or -1 when there's no server (or the
+// request couldn't be sent, or $LIST_SERVER isn't set) and the caller should list by itself
+inline int forward(const int argc, char** argv)
+{
+	const char* enabled = std::getenv("LIST_SERVER");
+	if(!enabled || !*enabled)
+		return -1;
+	const int sock = connectServer();
+	if(sock < 0)
+		return -1;
+
+	// The arguments and an empty one, then NAME=value for whatever of FORWARDED_ENV is set
+	std::string request;
+	for(int i = 0; i < argc; ++i)
+		request.append(argv[i]).push_back('\0');
+	request.push_back('\0');
+	for(const char* name: FORWARDED_ENV)
+		if(const char* value = std::getenv(name))
+			request.append(name).append("=").append(value).push_back('\0');
+
+	const int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	const int fds[3] = {cwd, STDOUT_FILENO, STDERR_FILENO};
+	char control[CMSG_SPACE(sizeof(fds))] = {};
+	iovec data {request.data(), request.size()};
+	msghdr message {};
+	message.msg_iov = &data;
+	message.msg_iovlen = 1U;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	cmsghdr* header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(sizeof(fds));
+	std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+	const bool sent =
+		cwd >= 0 && request.size() <= REQUEST_MAX && sendmsg(sock, &message, 0) >= 0;
+	if(cwd >= 0)
+		close(cwd);
+	if(!sent)
+	{
+		close(sock);
+		return -1;
+	}
+
+	// Once it's sent the server may have printed things already, no falling back after this
+	int32_t code = 1;
+	ssize_t got;
+	while((got = recv(sock, &code, sizeof(code), 0)) < 0 && errno == EINTR)
+		;
+	close(sock);
+	return got == sizeof(code) ? code : 1;
+}
+
+// Serves requests until it's killed, `run(argc, argv)` does one listing
+template<typename Run>
+int serve(Run&& run)
+{
+	sockaddr_un address;
+	if(!socketAddress(address))
+		return 2;
+	if(const int running = connectServer(); running >= 0)
+	{
+		close(running);
+		std::cerr << "list: already serving on " << address.sun_path << '\n';
+		return 2;
+	}
+	const int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	// A socket nobody's listening on is left over from a server that's gone
+	unlink(address.sun_path);
+	if(sock < 0 || bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+	   chmod(address.sun_path, 0600) != 0 || listen(sock, 64) != 0)
+	{
+		std::cerr << "list: can't listen on " << address.sun_path << ": " << std::strerror(errno)
+				  << '\n';
+		return 2;
+	}
+	// A client that goes away mid listing shouldn't take the server with it
+	signal(SIGPIPE, SIG_IGN);
+	const int own_out = dup(STDOUT_FILENO), own_err = dup(STDERR_FILENO);
+	const int root = open("/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+
+	// How long a client gets to send its request and to take the exit code, its request is
+	// sent right after it connects
+	const timeval timeout {1, 0};
+	std::vector<char> buffer(REQUEST_MAX);
+	for(;;)
+	{
+		const int client = accept4(sock, nullptr, nullptr, SOCK_CLOEXEC);
+		if(client < 0)
+			continue;
+		if(!sameUser(client) ||
+		   setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+		   setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0)
+		{
+			close(client);
+			continue;
+		}
+
+		char control[CMSG_SPACE(3U * sizeof(int))];
+		iovec data {buffer.data(), buffer.size()};
+		msghdr message {};
+		message.msg_iov = &data;
+		message.msg_iovlen = 1U;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		const ssize_t size = recvmsg(client, &message, MSG_CMSG_CLOEXEC);
+		// Nothing within the timeout, or the client's gone
+		if(size <= 0)
+		{
+			close(client);
+			continue;
+		}
+
+		int fds[3] = {-1, -1, -1};
+		const cmsghdr* header = CMSG_FIRSTHDR(&message);
+		if(size > 0 && header && header->cmsg_type == SCM_RIGHTS &&
+		   header->cmsg_len == CMSG_LEN(sizeof(fds)))
+			std::memcpy(fds, CMSG_DATA(header), sizeof(fds));
+
+		// The arguments up to the empty one, the environment after it. Every string ends inside
+		// what was received, a request without the empty one is cut short and isn't run
+		std::vector<char*> argv;
+		char* const end = buffer.data() + std::max<ssize_t>(size, 0);
+		char* item = buffer.data();
+		const bool whole = fds[0] >= 0 && !(message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) &&
+						   end[-1] == '\0';
+		for(; whole && item < end && *item; item += std::strlen(item) + 1U)
+			argv.push_back(item);
+		argv.push_back(nullptr);
+
+		int32_t code = 2;
+		if(whole && item < end)
+		{
+			for(const char* name: FORWARDED_ENV)
+				unsetenv(name);
+			for(++item; item < end; item += std::strlen(item) + 1U)
+				if(char* equals = std::strchr(item, '='))
+				{
+					*equals = '\0';
+					setenv(item, equals + 1, 1);
+				}
+			// localtime_r() doesn't look at TZ again by itself. -l's per-day cache lives as
+			// long as one listing, nothing of the last client's time zone is left in it
+			tzset();
+
+			if(fchdir(fds[0]) == 0 && argv.size() > 1U)
+			{
+				dup2(fds[1], STDOUT_FILENO);
+				dup2(fds[2], STDERR_FILENO);
+				code = run(int(argv.size() - 1U), argv.data());
+				std::cout.flush();
+				std::cerr.flush();
+				dup2(own_out, STDOUT_FILENO);
+				dup2(own_err, STDERR_FILENO);
+			}
+			// Not keeping the client's directory busy
+			if(fchdir(root) != 0)
+				code = 2;
+		}
+		for(const int fd: fds)
+			if(fd >= 0)
+				close(fd);
+		send(client, &code, sizeof(code), MSG_NOSIGNAL);
+		close(client);
+	}
+}
+
+#endif
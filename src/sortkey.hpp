@@ -0,0 +1,280 @@
+#ifndef SORTKEY_HPP
+#define SORTKEY_HPP
+
+// Sorting, directories always come first, then whatever the sort mode orders by, then names
+// in natural order: case insensitive, with every run of digits compared as a number, so file9
+// comes before file10. Names that still tie (file01 and file1, README and readme) are told
+// apart by their folded bytes and then their original ones, which makes the order total and
+// the same however the entries come in: --top and --mem-limit's merge rely on that.
+// Everything the comparison needs is worked out once per entry up front, time and size become
+// one fixed-size integer, the folded names live in one arena and the first 8 bytes of each
+// (numbers spelled out so they compare by value) are kept inline in the key, so most
+// comparisons never leave the key array and nothing gets allocated while sorting
+
+#include "meta.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SortMode
+{
+	name,
+	mtime,		  // -t, newest first
+	size,		  // -S, largest first
+	extension,	  // -X
+	none		  // -U, directory order
+};
+
+// The metadata a sort mode needs on top of what's printed
+inline unsigned int sortMask(const SortMode mode)
+{
+	return mode == SortMode::mtime ? STATX_TYPE | STATX_MTIME
+		   : mode == SortMode::size ? STATX_TYPE | STATX_SIZE
+									: 0U;
+}
+
+struct SortKey
+{
+	uint64_t primary;	 // Mode specific, compared first, smaller comes first
+	uint64_t prefix;	 // naturalPrefix(), so integer order is the order of most names
+	uint32_t offset, length;	// The whole folded name in the arena
+	uint32_t extension;			// Length of the folded extension, at the end of the name
+	uint32_t index;				// Which entry this is
+	bool dir;
+};
+
+inline char foldCase(const char letter)
+{
+	return (letter >= 'A' && letter <= 'Z') ? letter + ('a' - 'A') : letter;
+}
+
+inline bool isDigit(const char letter) { return letter >= '0' && letter <= '9'; }
+
+// Big endian first 8 bytes of `str`, zero padded
+inline uint64_t bytePrefix(const char* str, const size_t length)
+{
+	uint64_t prefix = 0U;
+	for(size_t i = 0U; i < length && i < 8U; ++i)
+		prefix |= uint64_t(static_cast<uint8_t>(str[i])) << (56U - 8U * i);
+	return prefix;
+}
+
+// Compares two folded strings whose bytePrefix()es are equal
+inline bool tailLess(const char* a, const size_t a_length, const char* b, const size_t b_length)
+{
+	if(a_length <= 8U || b_length <= 8U)
+		return a_length < b_length;
+	const int diff = std::memcmp(a + 8U, b + 8U, std::min(a_length, b_length) - 8U);
+	return diff != 0 ? diff < 0 : a_length < b_length;
+}
+
+// Compares two folded names with every run of digits taken as a number, <0, 0 or >0. Leading
+// zeros don't count, so file01 and file1 are equal here. A number and any other byte compare
+// like its first digit would, the digits are contiguous
+inline int naturalCompare(const char* a, const size_t a_length, const char* b,
+						  const size_t b_length)
+{
+	size_t i = 0U, j = 0U;
+	while(i < a_length && j < b_length)
+	{
+		if(isDigit(a[i]) && isDigit(b[j]))
+		{
+			while(i < a_length && a[i] == '0')
+				++i;
+			while(j < b_length && b[j] == '0')
+				++j;
+			size_t a_end = i, b_end = j;
+			while(a_end < a_length && isDigit(a[a_end]))
+				++a_end;
+			while(b_end < b_length && isDigit(b[b_end]))
+				++b_end;
+			// More digits is a bigger number, the same number of them compare like text
+			if(a_end - i != b_end - j)
+				return a_end - i < b_end - j ? -1 : 1;
+			if(const int diff = std::memcmp(a + i, b + j, a_end - i); diff != 0)
+				return diff;
+			i = a_end;
+			j = b_end;
+		}
+		else if(a[i] != b[j])
+			return static_cast<uint8_t>(a[i]) < static_cast<uint8_t>(b[j]) ? -1 : 1;
+		else
+		{
+			++i;
+			++j;
+		}
+	}
+	return int(i < a_length) - int(j < b_length);
+}
+
+// The first 8 bytes of a folded name spelled so that comparing them compares like
+// naturalCompare(): every run of digits as a '0' (for where it goes among the other bytes),
+// the number of digits without the leading zeros and those digits. Zero padded, big endian
+inline uint64_t naturalPrefix(const char* folded, const size_t length)
+{
+	uint64_t prefix = 0U;
+	unsigned int shift = 64U;
+	const auto put = [&](const char byte) {
+		shift -= 8U;
+		prefix |= uint64_t(static_cast<uint8_t>(byte)) << shift;
+	};
+	for(size_t i = 0U; i < length && shift > 0U;)
+		if(isDigit(folded[i]))
+		{
+			while(i < length && folded[i] == '0')
+				++i;
+			size_t end = i;
+			while(end < length && isDigit(folded[end]))
+				++end;
+			// NAME_MAX keeps the count within a byte
+			put('0');
+			if(shift > 0U)
+				put(char(end - i));
+			for(; i < end && shift > 0U; ++i)
+				put(folded[i]);
+			i = end;
+		}
+		else
+			put(folded[i++]);
+	return prefix;
+}
+
+// The natural order of two names, then names that only differ in leading zeros by their folded
+// bytes and names that only differ in case by their original ones (`name(key)`). 0 only for
+// the same name
+template<typename Name>
+inline int nameCompare(const SortKey& a, const char* a_folded, const SortKey& b,
+					   const char* b_folded, Name&& name)
+{
+	if(a.prefix != b.prefix)
+		return a.prefix < b.prefix ? -1 : 1;
+	if(const int order = naturalCompare(a_folded, a.length, b_folded, b.length); order != 0)
+		return order;
+	if(const int diff = std::memcmp(a_folded, b_folded, std::min(a.length, b.length)); diff != 0)
+		return diff;
+	if(a.length != b.length)
+		return a.length < b.length ? -1 : 1;
+	return std::strcmp(name(a), name(b));
+}
+
+// Everything in a key but its offset and index, `folded` is the case folded copy of `name`
+inline void fillKey(SortKey& key, const SortMode mode, const std::string_view name,
+					const char* folded, const bool dir, const FileMeta& meta)
+{
+	key.length = name.size();
+	key.dir = dir;
+
+	const size_t dot = name.rfind('.');
+	key.extension = dot == std::string_view::npos ? 0U : name.size() - dot - 1U;
+	key.prefix = naturalPrefix(folded, key.length);
+
+	// Descending orders are stored inverted so smaller always comes first
+	if(mode == SortMode::mtime)
+	{
+		// 34 bits of seconds (biased, so before 1970 still sorts right) and 30 of nanoseconds
+		const int64_t seconds = std::clamp<int64_t>(meta.mtime, -(1LL << 33), (1LL << 33) - 1);
+		key.primary = ~((uint64_t(seconds + (1LL << 33)) << 30U) | meta.mtime_nsec);
+	}
+	else if(mode == SortMode::size)
+		key.primary = ~(dir ? 4096ULL : meta.size);
+	else
+		key.primary = 0U;
+}
+
+// The ordering within directories or within files, <0, 0 or >0. `a_folded`/`b_folded` are the
+// whole folded names and `name(key)` gives the original one as a C string
+template<typename Name>
+inline int keyCompare(const SortMode mode, const SortKey& a, const char* a_folded,
+					  const SortKey& b, const char* b_folded, Name&& name)
+{
+	if(a.primary != b.primary)
+		return a.primary < b.primary ? -1 : 1;
+	if(mode == SortMode::extension)
+	{
+		const char* a_ext = a_folded + a.length - a.extension;
+		const char* b_ext = b_folded + b.length - b.extension;
+		const uint64_t a_prefix = bytePrefix(a_ext, a.extension),
+					   b_prefix = bytePrefix(b_ext, b.extension);
+		if(a_prefix != b_prefix)
+			return a_prefix < b_prefix ? -1 : 1;
+		if(tailLess(a_ext, a.extension, b_ext, b.extension))
+			return -1;
+		if(tailLess(b_ext, b.extension, a_ext, a.extension))
+			return 1;
+	}
+	return nameCompare(a, a_folded, b, b_folded, name);
+}
+
+// The whole ordering, directories first and -r only flipping what comes after that
+template<typename Name>
+inline int entryCompare(const SortMode mode, const bool reverse, const SortKey& a,
+						const char* a_folded, const SortKey& b, const char* b_folded, Name&& name)
+{
+	if(a.dir != b.dir)
+		return a.dir ? -1 : 1;
+	return reverse ? keyCompare(mode, b, b_folded, a, a_folded, name)
+				   : keyCompare(mode, a, a_folded, b, b_folded, name);
+}
+
+template<typename Name>
+inline bool entryLess(const SortMode mode, const bool reverse, const SortKey& a,
+					  const char* a_folded, const SortKey& b, const char* b_folded, Name&& name)
+{
+	return entryCompare(mode, reverse, a, a_folded, b, b_folded, name) < 0;
+}
+
+class SortKeys
+{
+private:
+	const SortMode mode;
+	const bool reverse;
+	std::string arena;
+	std::vector<SortKey> keys;
+
+public:
+	explicit SortKeys(const SortMode sort_mode = SortMode::name,
+					  const bool reversed = false,
+					  const size_t count = 0U,
+					  const size_t name_bytes = 0U) :
+		mode(sort_mode), reverse(reversed)
+	{
+		keys.reserve(count);
+		arena.reserve(name_bytes);
+	}
+
+	// `meta` only matters for -t and -S
+	void add(const std::string_view name, const bool dir, const FileMeta& meta)
+	{
+		SortKey key;
+		key.offset = arena.size();
+		key.index = keys.size();
+		for(const char letter: name)
+			arena.push_back(foldCase(letter));
+		fillKey(key, mode, name, arena.data() + key.offset, dir, meta);
+		keys.push_back(key);
+	}
+
+	// Sorts and returns the keys, `name(i)` gives the original name of entry i as a C string.
+	// Entries that compare equal (only the same name twice) stay in the order they were added,
+	// like --mem-limit's merge keeps them in run order
+	template<typename Name>
+	const std::vector<SortKey>& sort(Name&& name)
+	{
+		if(mode == SortMode::none)
+			return keys;
+		const char* folded = arena.data();
+		auto original = [&](const SortKey& key) { return name(key.index); };
+		std::sort(keys.begin(), keys.end(), [&](const SortKey& a, const SortKey& b) {
+			const int order =
+				entryCompare(mode, reverse, a, folded + a.offset, b, folded + b.offset, original);
+			return order != 0 ? order < 0 : a.index < b.index;
+		});
+		return keys;
+	}
+};
+
+#endif
@@ -0,0 +1,126 @@
+// The sort order's own guarantees, run by `make test`. Names full of digits, leading zeros and
+// case differences (the ones that used to form cycles like 168 < 1qwy < 7 < 168) are checked to
+// be ordered strictly and transitively in every mode, and sorting them has to give the same
+// order whatever order they come in
+
+#include "sortkey.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Named
+{
+	std::string name, folded;
+	FileMeta meta;
+	SortKey key;
+};
+
+std::vector<Named> makeNames(std::mt19937& random, const SortMode mode, const size_t count)
+{
+	static const char* const pieces[] = {
+		"0", "00", "007", "1", "7", "9", "10", "168", "99999999999", "a", "B", "qwy",
+		"Q", "file", "FILE", ".", "-", "_", "~", ".txt", ".TXT", ".tar.gz", "é", "z"};
+	std::vector<Named> names;
+	std::vector<std::string> seen;
+	while(names.size() < count)
+	{
+		std::string name;
+		for(unsigned int piece = random() % 5U + 1U; piece > 0U; --piece)
+			name += pieces[random() % (sizeof(pieces) / sizeof(*pieces))];
+		if(std::find(seen.begin(), seen.end(), name) != seen.end())
+			continue;
+		seen.push_back(name);
+
+		Named named;
+		named.name = name;
+		named.folded.resize(name.size());
+		std::transform(name.begin(), name.end(), named.folded.begin(), foldCase);
+		named.meta.size = random() % 4U;
+		named.meta.mtime = random() % 4U;
+		named.key.index = names.size();
+		named.key.offset = 0U;
+		fillKey(named.key, mode, name, named.folded.data(), random() % 8U == 0U, named.meta);
+		names.push_back(std::move(named));
+	}
+	return names;
+}
+
+int main()
+{
+	std::mt19937 random(9);
+	int failures = 0;
+	const auto fail = [&](const char* what, const std::string& a, const std::string& b,
+						  const std::string& c = "") {
+		if(++failures <= 20)
+			std::fprintf(
+				stderr, "%s: \"%s\" \"%s\" \"%s\"\n", what, a.c_str(), b.c_str(), c.c_str());
+	};
+
+	for(const SortMode mode: {SortMode::name, SortMode::mtime, SortMode::size, SortMode::extension})
+		for(const bool reverse: {false, true})
+		{
+			const std::vector<Named> names = makeNames(random, mode, 180U);
+			const auto name = [&](const SortKey& key) { return names[key.index].name.c_str(); };
+			const auto compare = [&](const Named& a, const Named& b) {
+				return entryCompare(
+					mode, reverse, a.key, a.folded.data(), b.key, b.folded.data(), name);
+			};
+
+			// Distinct names never tie, and a < b exactly when b > a
+			for(const Named& a: names)
+				for(const Named& b: names)
+				{
+					const int order = compare(a, b);
+					if((order == 0) != (&a == &b))
+						fail("tie", a.name, b.name);
+					if((order < 0) != (compare(b, a) > 0))
+						fail("asymmetric", a.name, b.name);
+				}
+			for(const Named& a: names)
+				for(const Named& b: names)
+					if(compare(a, b) < 0)
+						for(const Named& c: names)
+							if(compare(b, c) < 0 && compare(a, c) >= 0)
+								fail("intransitive", a.name, b.name, c.name);
+
+			// The same order out of SortKeys from any starting order
+			std::vector<std::string> first;
+			for(int round = 0; round < 20; ++round)
+			{
+				std::vector<uint32_t> shuffled(names.size());
+				for(uint32_t i = 0U; i < shuffled.size(); ++i)
+					shuffled[i] = i;
+				std::shuffle(shuffled.begin(), shuffled.end(), random);
+				SortKeys keys(mode, reverse, names.size());
+				for(const uint32_t i: shuffled)
+					keys.add(names[i].name, names[i].key.dir, names[i].meta);
+				std::vector<std::string> sorted;
+				for(const SortKey& key:
+					keys.sort([&](const uint32_t i) { return names[shuffled[i]].name.c_str(); }))
+					sorted.push_back(names[shuffled[key.index]].name);
+				if(first.empty())
+					first = sorted;
+				else if(sorted != first)
+					fail("order depends on the input", sorted.front(), first.front());
+			}
+		}
+
+	// Digit runs are numbers
+	const std::vector<std::string> expected = {
+		"1", "1qwy", "007", "7", "9", "10", "168", "a", "file1.txt", "file01b", "file9", "File10"};
+	SortKeys keys(SortMode::name, false, expected.size());
+	for(auto name = expected.rbegin(); name != expected.rend(); ++name)
+		keys.add(*name, false, FileMeta());
+	const std::vector<SortKey>& sorted =
+		keys.sort([&](const uint32_t i) { return expected[expected.size() - 1U - i].c_str(); });
+	for(size_t i = 0U; i < sorted.size(); ++i)
+		if(expected[expected.size() - 1U - sorted[i].index] != expected[i])
+			fail("natural order", expected[expected.size() - 1U - sorted[i].index], expected[i]);
+
+	if(failures)
+		std::fprintf(stderr, "sortkey_test: %d failures\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+#ifndef TABLE_HPP
+#define TABLE_HPP
+
+// The entries of a listing, stored column by column. Every name lives in one arena and is
+// referred to by offset/length, icons are indices into icon_list and the per entry metadata
+// is only allocated when the output (or the sort) actually needs it. A million entries cost
+// roughly their name bytes plus ~11 bytes each in the grid view, and the sort and layout
+// passes walk small dense arrays instead of chasing std::string pointers. All of it comes from
+// the memory_resource the table is made with, the default one unless liblist is handed another
+
+#include "icons.hpp"
+#include "meta.hpp"
+#include "scan.hpp"
+#include "sortkey.hpp"
+#include "uring.hpp"
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class EntryTable
+{
+private:
+	// Names back to back, each followed by a '\0' so they double as C strings for statx()
+	std::pmr::string arena;
+	std::pmr::vector<uint32_t> offsets;
+	std::pmr::vector<uint8_t> lengths;	  // NAME_MAX is 255
+	std::pmr::vector<uint8_t> widths;	  // In terminal columns, never more than the length
+	std::pmr::vector<uint16_t> icons;	  // Index into icon_list or NO_ICON
+	std::pmr::vector<uint8_t> types;	  // DT_*, links to directories become DT_DIR once resolved
+	std::pmr::vector<FileMeta> metas;	  // Empty unless metadata was asked for
+	std::pmr::vector<char> statuses;	  // --git's markers, empty without it
+
+public:
+	explicit EntryTable(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) :
+		arena(memory),
+		offsets(memory),
+		lengths(memory),
+		widths(memory),
+		icons(memory),
+		types(memory),
+		metas(memory),
+		statuses(memory)
+	{
+	}
+
+	void reserve(const size_t count, const size_t name_bytes = 0U)
+	{
+		offsets.reserve(count);
+		lengths.reserve(count);
+		widths.reserve(count);
+		icons.reserve(count);
+		types.reserve(count);
+		arena.reserve(name_bytes ? name_bytes : count * 16U);
+	}
+
+	// Empties the table but keeps its memory, for reusing it batch after batch
+	void clear()
+	{
+		arena.clear();
+		offsets.clear();
+		lengths.clear();
+		widths.clear();
+		icons.clear();
+		types.clear();
+		metas.clear();
+		statuses.clear();
+	}
+
+	size_t size() const { return offsets.size(); }
+	bool empty() const { return offsets.empty(); }
+	size_t nameBytes() const { return arena.size(); }
+	// Roughly what the table holds on to, counting the metadata even before it's fetched
+	size_t footprint(const bool with_meta) const
+	{
+		return arena.size() + size() * (sizeof(uint32_t) + 3U * sizeof(uint8_t) + sizeof(uint16_t) +
+										 (with_meta ? sizeof(FileMeta) : 0U));
+	}
+
+	void add(const std::string_view name, const unsigned char type)
+	{
+		offsets.push_back(arena.size());
+		lengths.push_back(name.size());
+		widths.push_back(displayWidth(name));
+		icons.push_back(findIcon(name));
+		types.push_back(type);
+		arena.append(name).push_back('\0');
+	}
+
+	std::string_view name(const size_t i) const
+	{
+		return std::string_view(arena.data() + offsets[i], lengths[i]);
+	}
+	const char* cName(const size_t i) const { return arena.data() + offsets[i]; }
+	size_t width(const size_t i) const { return widths[i]; }
+	uint16_t icon(const size_t i) const { return icons[i]; }
+	unsigned char type(const size_t i) const { return types[i]; }
+	bool isDir(const size_t i) const { return types[i] == DT_DIR; }
+
+	bool hasMeta() const { return !metas.empty(); }
+	const FileMeta& meta(const size_t i) const { return metas[i]; }
+	FileMeta& meta(const size_t i) { return metas[i]; }
+	void setMeta(const size_t i, const FileMeta& meta)
+	{
+		if(metas.size() <= i)
+			metas.resize(size());
+		metas[i] = meta;
+		if(meta.is_dir)
+			types[i] = DT_DIR;
+	}
+
+	bool hasStatus() const { return !statuses.empty(); }
+	char status(const size_t i) const { return statuses[i]; }
+	// The first call makes room for every entry, later ones (on other threads too) only write
+	void setStatus(const size_t i, const char status)
+	{
+		if(statuses.size() <= i)
+			statuses.resize(size(), ' ');
+		statuses[i] = status;
+	}
+
+	// The metadata pass, statx for every entry when `mask` asks for anything, otherwise only
+	// for the ones getdents couldn't give a usable type for (symlinks, DT_UNKNOWN), and those
+	// only to find out whether they're directories. Nothing else touches the table until it's
+	// done, --jobs threads each fill their own slots
+	void fetchMeta(const IoMode mode, const unsigned int jobs, const int dirfd, const unsigned int mask)
+	{
+		std::pmr::vector<uint32_t> pending(offsets.get_allocator());
+		for(uint32_t i = 0U; i < size(); ++i)
+			if(needsStat(types[i], mask))
+				pending.push_back(i);
+
+		std::pmr::vector<FileMeta> scratch(metas.get_allocator());
+		std::pmr::vector<FileMeta>& results = mask ? metas : scratch;
+		if(mask)
+			metas.resize(size());
+		else
+			scratch.resize(pending.size());
+		auto slot = [&](const size_t k) { return mask ? pending[k] : k; };
+		for(size_t k = 0U; k < pending.size(); ++k)
+		{
+			results[slot(k)].mode = DTTOIF(types[pending[k]]);
+			results[slot(k)].is_dir = types[pending[k]] == DT_DIR;
+		}
+		fetchMetaAll(
+			mode,
+			jobs,
+			dirfd,
+			pending.size(),
+			mask,
+			[&](const size_t k) { return cName(pending[k]); },
+			[&](const size_t k) -> FileMeta& { return results[slot(k)]; });
+
+		for(size_t k = 0U; k < pending.size(); ++k)
+			if(results[slot(k)].is_dir)
+				types[pending[k]] = DT_DIR;
+	}
+};
+
+// The order the table's entries are listed in, indices into the table
+inline std::vector<uint32_t> sortTable(const EntryTable& table, const SortMode mode,
+									   const bool reverse)
+{
+	std::vector<uint32_t> order(table.size());
+	if(mode == SortMode::none)
+	{
+		for(uint32_t i = 0U; i < order.size(); ++i)
+			order[i] = i;
+		return order;
+	}
+
+	static const FileMeta no_meta;
+	SortKeys keys(mode, reverse, table.size(), table.nameBytes());
+	for(size_t i = 0U; i < table.size(); ++i)
+		keys.add(table.name(i), table.isDir(i), table.hasMeta() ? table.meta(i) : no_meta);
+	const std::vector<SortKey>& sorted = keys.sort([&](const uint32_t i) { return table.cName(i); });
+	for(size_t i = 0U; i < sorted.size(); ++i)
+		order[i] = sorted[i].index;
+	return order;
+}
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef THEME_HPP
+#define THEME_HPP
+
+// Every color list uses, with the escape sequences built at compile time for each color depth.
+// One theme is picked at startup and printing a color is just copying its bytes
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+enum Role : uint8_t
+{
+	RESET,
+	ERROR,
+	NOTICE,
+	// ls -l, permission bits
+	PERM_READ,
+	PERM_WRITE,
+	PERM_EXEC,
+	PERM_NONE,
+	GROUP,
+	// Sizes, < 1MB, < 128MB, < 512MB, < 1GB and bigger
+	SIZE_TINY,
+	SIZE_SMALL,
+	SIZE_MEDIUM,
+	SIZE_LARGE,
+	SIZE_HUGE,
+	// Modification times, > 3 days, > 1 day, > 6 hours, > 1 hour and newer
+	TIME_OLD,
+	TIME_DAYS,
+	TIME_TODAY,
+	TIME_HOURS,
+	TIME_RECENT,
+	DIRECTORY,
+	FILE_NAME,
+	// --git, modified, untracked, ignored and unmerged
+	GIT_MODIFIED,
+	GIT_UNTRACKED,
+	GIT_IGNORED,
+	GIT_CONFLICT,
+	ROLE_COUNT
+};
+
+enum class ColorDepth : uint8_t
+{
+	none,
+	ansi16,
+	ansi256,
+	truecolor
+};
+
+struct Rgb
+{
+	uint8_t r, g, b;
+};
+
+// The palette, in 24-bit colors, RESET and ERROR aren't colors so they're special cased
+constexpr Rgb palette[ROLE_COUNT] = {
+	{0, 0, 0},			// RESET
+	{255, 0, 0},		// ERROR
+	{229, 195, 38},		// NOTICE
+	{230, 220, 59},		// PERM_READ
+	{42, 228, 52},		// PERM_WRITE
+	{224, 58, 32},		// PERM_EXEC
+	{88, 40, 128},		// PERM_NONE
+	{205, 196, 101},	// GROUP
+	{255, 255, 255},	// SIZE_TINY
+	{113, 220, 208},	// SIZE_SMALL
+	{253, 254, 42},		// SIZE_MEDIUM
+	{222, 132, 88},		// SIZE_LARGE
+	{3, 255, 255},		// SIZE_HUGE
+	{32, 123, 121},		// TIME_OLD
+	{72, 144, 240},		// TIME_DAYS
+	{108, 222, 171},	// TIME_TODAY
+	{146, 240, 190},	// TIME_HOURS
+	{20, 255, 40},		// TIME_RECENT
+	{20, 162, 254},		// DIRECTORY
+	{0, 255, 0},		// FILE_NAME
+	{253, 151, 31},		// GIT_MODIFIED
+	{42, 228, 52},		// GIT_UNTRACKED
+	{110, 110, 110},	// GIT_IGNORED
+	{240, 60, 60},		// GIT_CONFLICT
+};
+
+// A fixed size escape sequence, "\033[38;2;255;255;255m" is the longest one
+struct Escape
+{
+	char data[24] = {};
+	uint8_t size = 0U;
+
+	constexpr void append(const char* str)
+	{
+		while(*str)
+			data[size++] = *str++;
+	}
+
+	constexpr void number(const unsigned int value)
+	{
+		if(value >= 100U)
+			data[size++] = '0' + value / 100U;
+		if(value >= 10U)
+			data[size++] = '0' + value / 10U % 10U;
+		data[size++] = '0' + value % 10U;
+	}
+
+	constexpr operator std::string_view() const { return std::string_view(data, size); }
+};
+
+constexpr unsigned int distance(const Rgb& a, const Rgb& b)
+{
+	const int r = a.r - b.r, g = a.g - b.g, bl = a.b - b.b;
+	return r * r + g * g + bl * bl;
+}
+
+// Closest entry of the xterm 256 color palette, either the 6x6x6 cube or the gray ramp
+constexpr unsigned int to256(const Rgb& color)
+{
+	constexpr uint8_t levels[6] = {0, 95, 135, 175, 215, 255};
+	auto level = [](const uint8_t value) -> unsigned int {
+		return value < 48U ? 0U : value < 115U ? 1U : (value - 35U) / 40U;
+	};
+	const unsigned int r = level(color.r), g = level(color.g), b = level(color.b);
+	const Rgb cube {levels[r], levels[g], levels[b]};
+
+	const unsigned int average = (color.r + color.g + color.b) / 3U;
+	const unsigned int gray = average < 8U ? 0U : average > 238U ? 23U : (average - 8U) / 10U;
+	const uint8_t gray_value = 8U + gray * 10U;
+	const Rgb ramp {gray_value, gray_value, gray_value};
+
+	return distance(color, ramp) < distance(color, cube) ? 232U + gray
+														 : 16U + 36U * r + 6U * g + b;
+}
+
+// Closest of the 16 basic colors, as xterm draws them by default
+constexpr unsigned int to16(const Rgb& color)
+{
+	constexpr Rgb basic[16] = {{0, 0, 0},
+							   {205, 0, 0},
+							   {0, 205, 0},
+							   {205, 205, 0},
+							   {0, 0, 238},
+							   {205, 0, 205},
+							   {0, 205, 205},
+							   {229, 229, 229},
+							   {127, 127, 127},
+							   {255, 0, 0},
+							   {0, 255, 0},
+							   {255, 255, 0},
+							   {92, 92, 255},
+							   {255, 0, 255},
+							   {0, 255, 255},
+							   {255, 255, 255}};
+	unsigned int best = 0U;
+	for(unsigned int i = 1U; i < 16U; ++i)
+		if(distance(color, basic[i]) < distance(color, basic[best]))
+			best = i;
+	return best;
+}
+
+constexpr Escape makeEscape(const Role role, const ColorDepth depth)
+{
+	Escape escape;
+	if(depth == ColorDepth::none)
+		return escape;
+	if(role == RESET)
+		escape.append("\033[m");
+	else if(role == ERROR)
+		escape.append("\033[1;31m");
+	else if(depth == ColorDepth::truecolor)
+	{
+		escape.append("\033[38;2;");
+		escape.number(palette[role].r);
+		escape.append(";");
+		escape.number(palette[role].g);
+		escape.append(";");
+		escape.number(palette[role].b);
+		escape.append("m");
+	}
+	else if(depth == ColorDepth::ansi256)
+	{
+		escape.append("\033[38;5;");
+		escape.number(to256(palette[role]));
+		escape.append("m");
+	}
+	else
+	{
+		const unsigned int color = to16(palette[role]);
+		escape.append(color < 8U ? "\033[3" : "\033[9");
+		escape.number(color % 8U);
+		escape.append("m");
+	}
+	return escape;
+}
+
+using Theme = std::array<Escape, ROLE_COUNT>;
+
+constexpr Theme makeTheme(const ColorDepth depth)
+{
+	Theme theme {};
+	for(unsigned int role = 0U; role < ROLE_COUNT; ++role)
+		theme[role] = makeEscape(static_cast<Role>(role), depth);
+	return theme;
+}
+
+// Indexed by ColorDepth
+constexpr Theme themes[4] = {makeTheme(ColorDepth::none),
+							 makeTheme(ColorDepth::ansi16),
+							 makeTheme(ColorDepth::ansi256),
+							 makeTheme(ColorDepth::truecolor)};
+
+// --color=auto|always|never|256|16, auto drops the colors when NO_COLOR is set or stdout isn't
+// a terminal
+inline const Theme& selectTheme(const std::string& option)
+{
+	ColorDepth depth = ColorDepth::truecolor;
+	if(option == "never")
+		depth = ColorDepth::none;
+	else if(option == "256")
+		depth = ColorDepth::ansi256;
+	else if(option == "16")
+		depth = ColorDepth::ansi16;
+	else if(option != "always")
+	{
+		const char* no_color = std::getenv("NO_COLOR");
+		if((no_color && *no_color) || !isatty(STDOUT_FILENO))
+			depth = ColorDepth::none;
+	}
+	return themes[static_cast<uint8_t>(depth)];
+}
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef TIMEFMT_HPP
+#define TIMEFMT_HPP
+
+// The long listing's time column. Turning a timestamp into a local date is what costs, each
+// localtime() takes a lock and looks at the time zone again, so it's only asked once per local
+// day seen: that day's date, weekday and UTC offset are kept in a small table and every time on
+// it is that plus the seconds since its midnight. A day with a daylight saving change in it isn't
+// kept, localtime() is asked for every time on it. The text is written straight into the output
+// buffer, and the current time is taken once for the whole listing
+
+#include "output.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <string>
+
+enum class TimeStyle
+{
+	classic,	 // Sun Oct 18 07:22:03 2026, what ctime() gives
+	iso,		 // 10-18 07:22 for the last six months, 2026-10-18 before that or in the future
+	long_iso,	 // 2026-10-18 07:22
+	full_iso,	 // 2026-10-18 07:22:03.123456789 +0200
+	relative	 // 5 minutes ago
+};
+
+// --time-style's words, anything else is the classic one
+inline TimeStyle parseTimeStyle(const std::string& word)
+{
+	return word == "iso"		? TimeStyle::iso
+		   : word == "long-iso" ? TimeStyle::long_iso
+		   : word == "full-iso" ? TimeStyle::full_iso
+		   : word == "relative" ? TimeStyle::relative
+								: TimeStyle::classic;
+}
+
+class TimeFormat
+{
+private:
+	struct Date
+	{
+		int64_t year;
+		unsigned int month, day, weekday, hour, minute, second;
+		long offset;	// Seconds east of UTC
+	};
+	// A cached day, times from `start` up to `end` are on it
+	struct Day
+	{
+		int64_t start = 1, end = 0;
+		Date date;
+	};
+	static constexpr size_t DAYS = 64U;
+	static constexpr int64_t SIX_MONTHS = 31556952 / 2;
+
+	const TimeStyle style;
+	const std::time_t current;
+	long guess;	   // Today's offset, to tell which slot a time's day goes in
+	std::array<Day, DAYS> days;
+
+	static bool breakDown(const std::time_t seconds, Date& date)
+	{
+		struct tm fields;
+		if(!localtime_r(&seconds, &fields))
+			return false;
+		date = {fields.tm_year + 1900LL,
+				unsigned(fields.tm_mon),
+				unsigned(fields.tm_mday),
+				unsigned(fields.tm_wday),
+				unsigned(fields.tm_hour),
+				unsigned(fields.tm_min),
+				unsigned(fields.tm_sec),
+				fields.tm_gmtoff};
+		return true;
+	}
+
+	bool lookup(const int64_t seconds, Date& date)
+	{
+		const int64_t local = seconds + guess;
+		const int64_t number = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+		Day& day = days[uint64_t(number) % DAYS];
+		if(seconds < day.start || seconds >= day.end)
+		{
+			if(!breakDown(seconds, date))
+				return false;
+			// Kept if the day starts and ends at the same offset, and lasts 24 hours
+			const int64_t start = seconds - (date.hour * 3600 + date.minute * 60 + date.second);
+			Date first, last;
+			if(!breakDown(start, first) || !breakDown(start + 86399, last) ||
+			   first.offset != date.offset || last.offset != date.offset || last.day != date.day)
+				return true;
+			day.start = start;
+			day.end = start + 86400;
+			day.date = date;
+		}
+		const int64_t since = seconds - day.start;
+		date = day.date;
+		date.hour = since / 3600;
+		date.minute = since / 60 % 60;
+		date.second = since % 60;
+		return true;
+	}
+
+	static char* two(char* out, const unsigned int value)
+	{
+		out[0] = '0' + value / 10U;
+		out[1] = '0' + value % 10U;
+		return out + 2;
+	}
+
+	// At least 4 digits
+	static char* year(char* out, const int64_t value)
+	{
+		if(value < 0)
+			*out++ = '-';
+		const uint64_t magnitude = value < 0 ? -uint64_t(value) : uint64_t(value);
+		if(magnitude >= 10000U)
+			return out + toChars(out, magnitude);
+		out = two(out, magnitude / 100U);
+		return two(out, magnitude % 100U);
+	}
+
+	// YYYY-MM-DD
+	static char* isoDate(char* out, const Date& date)
+	{
+		out = year(out, date.year);
+		*out++ = '-';
+		out = two(out, date.month + 1U);
+		*out++ = '-';
+		return two(out, date.day);
+	}
+
+	// HH:MM
+	static char* clock(char* out, const Date& date)
+	{
+		out = two(out, date.hour);
+		*out++ = ':';
+		return two(out, date.minute);
+	}
+
+	// "  5 minutes ago", always 15 columns
+	char* relative(char* out, const int64_t seconds) const
+	{
+		static constexpr struct
+		{
+			int64_t length;
+			const char* name;
+		} units[] = {{31556952, "year"},
+					 {2629746, "month"},
+					 {604800, "week"},
+					 {86400, "day"},
+					 {3600, "hour"},
+					 {60, "minute"},
+					 {1, "second"}};
+		const int64_t ago = current - seconds;
+		if(ago < 0)
+		{
+			std::memcpy(out, "  in the future", 15U);
+			return out + 15;
+		}
+		size_t unit = 0U;
+		while(unit + 1U < std::size(units) && ago < units[unit].length)
+			++unit;
+		const uint64_t count = ago / units[unit].length;
+		char digits[20];
+		const size_t length = toChars(digits, count);
+		// The count right aligned in 3 columns, the unit left aligned in 7
+		if(length < 3U)
+		{
+			std::memset(out, ' ', 3U - length);
+			out += 3U - length;
+		}
+		std::memcpy(out, digits, length);
+		out[length] = ' ';
+		out += length + 1U;
+		size_t name = std::strlen(units[unit].name);
+		std::memcpy(out, units[unit].name, name);
+		if(count != 1U)
+			out[name++] = 's';
+		std::memset(out + name, ' ', 8U - name);
+		std::memcpy(out + 8, "ago", 3U);
+		return out + 11;
+	}
+
+public:
+	TimeFormat(const TimeStyle time_style, const std::time_t now) :
+		style(time_style), current(now), guess(0)
+	{
+		Date today;
+		if(breakDown(now, today))
+			guess = today.offset;
+	}
+
+	std::time_t now() const { return current; }
+
+	// The longest a time can get, a year with a lot of digits
+	static constexpr size_t MAX_SIZE = 64U;
+
+	// Writes the time at `seconds` and `nanoseconds` to `out` (MAX_SIZE bytes), returns its
+	// length. Every time takes the same width in a style, unless its year has over 4 digits
+	size_t format(char* out, const int64_t seconds, const uint32_t nanoseconds)
+	{
+		static constexpr char weekdays[] = "SunMonTueWedThuFriSat";
+		static constexpr char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+		char* at = out;
+		Date when;
+		if(style == TimeStyle::relative)
+			return relative(out, seconds) - out;
+		if(!lookup(seconds, when))
+		{
+			*out = '?';
+			return 1U;
+		}
+		switch(style)
+		{
+			case TimeStyle::classic:
+				std::memcpy(at, weekdays + 3U * when.weekday, 3U);
+				at[3] = ' ';
+				std::memcpy(at + 4, months + 3U * when.month, 3U);
+				at[7] = ' ';
+				two(at + 8, when.day);
+				if(when.day < 10U)
+					at[8] = ' ';
+				at[10] = ' ';
+				at = clock(at + 11, when);
+				*at++ = ':';
+				at = two(at, when.second);
+				*at++ = ' ';
+				return year(at, when.year) - out;
+			case TimeStyle::iso:
+				if(seconds > current - SIX_MONTHS && seconds <= current)
+				{
+					at = two(at, when.month + 1U);
+					*at++ = '-';
+					at = two(at, when.day);
+					*at++ = ' ';
+					return clock(at, when) - out;
+				}
+				at = isoDate(at, when);
+				*at++ = ' ';
+				return at - out;
+			case TimeStyle::long_iso:
+				at = isoDate(at, when);
+				*at++ = ' ';
+				return clock(at, when) - out;
+			default:
+			{
+				at = isoDate(at, when);
+				*at++ = ' ';
+				at = clock(at, when);
+				*at++ = ':';
+				at = two(at, when.second);
+				*at++ = '.';
+				uint32_t left = nanoseconds % 1000000000U;
+				for(uint32_t digit = 100000000U; digit; digit /= 10U)
+				{
+					*at++ = '0' + left / digit;
+					left %= digit;
+				}
+				const long offset = when.offset < 0 ? -when.offset : when.offset;
+				*at++ = ' ';
+				*at++ = when.offset < 0 ? '-' : '+';
+				at = two(at, offset / 3600 % 100);
+				return two(at, offset / 60 % 60) - out;
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef TOP_HPP
+#define TOP_HPP
+
+// --top N, only the first N entries of the sorted listing. The directory is read batch by
+// batch as usual, but instead of the table every entry is offered to a heap of the N best so
+// far, with the worst of them on top. A candidate that doesn't beat it is dropped after one
+// comparison, its name never copied anywhere; one that does takes the worst one's slot. Memory
+// is N entries and a getdents buffer whatever the size of the directory, and the only sort is
+// of the N that are left. With -U the first N read are the top, reading stops there
+
+#include "meta.hpp"
+#include "sortkey.hpp"
+#include "table.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TopEntries
+{
+private:
+	struct Slot
+	{
+		std::string name, folded;
+		unsigned char type;
+		FileMeta meta;
+		SortKey key;
+	};
+	// The index a candidate's key gets, so the version number comparison can find its name
+	static constexpr uint32_t CANDIDATE = UINT32_MAX;
+
+	const size_t limit;
+	const SortMode mode;
+	const bool reverse;
+	std::vector<Slot> slots;
+	std::vector<uint32_t> heap;	   // Slot indices, the worst entry first
+	std::string folded;			   // The candidate's folded name
+	const char* candidate;		   // and its original one
+
+	bool less(const SortKey& a, const char* a_folded, const SortKey& b, const char* b_folded) const
+	{
+		return entryLess(mode, reverse, a, a_folded, b, b_folded, [&](const SortKey& key) {
+			return key.index == CANDIDATE ? candidate : slots[key.index].name.c_str();
+		});
+	}
+	bool heapLess(const uint32_t a, const uint32_t b) const
+	{
+		return less(slots[a].key, slots[a].folded.data(), slots[b].key, slots[b].folded.data());
+	}
+
+public:
+	TopEntries(const size_t count, const SortMode sort_mode, const bool reversed) :
+		limit(count), mode(sort_mode), reverse(reversed), candidate(nullptr)
+	{
+		slots.reserve(std::min<size_t>(count, 1U << 16U));
+		heap.reserve(slots.capacity());
+	}
+
+	// Nothing later in the directory can make it in any more
+	bool full() const { return mode == SortMode::none && slots.size() >= limit; }
+
+	// Every entry of `batch`, with the metadata the sort needs
+	void offer(const EntryTable& batch)
+	{
+		static const FileMeta no_meta;
+		const auto heap_less = [this](const uint32_t a, const uint32_t b) { return heapLess(a, b); };
+		for(size_t i = 0U; i < batch.size() && !full(); ++i)
+		{
+			const std::string_view name = batch.name(i);
+			const FileMeta& meta = batch.hasMeta() ? batch.meta(i) : no_meta;
+			folded.resize(name.size());
+			std::transform(name.begin(), name.end(), folded.begin(), foldCase);
+			candidate = batch.cName(i);
+			SortKey key;
+			key.index = CANDIDATE;
+			fillKey(key, mode, name, folded.data(), batch.isDir(i), meta);
+
+			uint32_t slot = slots.size();
+			if(slots.size() < limit)
+				slots.emplace_back();
+			else
+			{
+				const Slot& worst = slots[heap.front()];
+				if(mode == SortMode::none || !less(key, folded.data(), worst.key, worst.folded.data()))
+					continue;
+				std::pop_heap(heap.begin(), heap.end(), heap_less);
+				slot = heap.back();
+				heap.pop_back();
+			}
+
+			Slot& kept = slots[slot];
+			kept.name.assign(name);
+			kept.folded.swap(folded);
+			kept.type = batch.type(i);
+			kept.meta = meta;
+			kept.key = key;
+			kept.key.index = slot;
+			heap.push_back(slot);
+			std::push_heap(heap.begin(), heap.end(), heap_less);
+		}
+	}
+
+	// Moves the survivors into `table`, still to be sorted, with metadata if there was any
+	void fill(EntryTable& table, const bool with_meta)
+	{
+		table.reserve(slots.size());
+		for(const Slot& slot: slots)
+		{
+			table.add(slot.name, slot.type);
+			if(with_meta)
+				table.setMeta(table.size() - 1U, slot.meta);
+		}
+		slots.clear();
+		heap.clear();
+	}
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef TREE_HPP
+#define TREE_HPP
+
+// The recursive walk behind -R and --tree. Every directory is a task on a StealingPool, the
+// worker that takes it opens it relative to its parent's descriptor, reads, stats and sorts it
+// and pushes its subdirectories as new tasks. The printing thread follows the tree in sorted
+// depth first order behind the workers, waiting on each directory until it's read, so the
+// output doesn't depend on how the work got split up and starts before the walk is over
+
+#include "meta.hpp"
+#include "pool.hpp"
+#include "scan.hpp"
+#include "sortkey.hpp"
+#include "table.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+struct TreeNode
+{
+	enum Status : uint8_t
+	{
+		pending,
+		listed,
+		skipped,	// A symlink, or on another filesystem with -x
+		failed		// Couldn't be opened or read, `error` says why
+	};
+
+	std::string path;
+	size_t name = 0U;	  // Where the directory's own name starts in `path`
+	uint32_t entry = 0U;	// Its index in the parent's table
+	unsigned int depth = 0U;
+	TreeNode* parent = nullptr;
+
+	EntryTable table;
+	std::vector<uint32_t> order;
+	std::vector<std::unique_ptr<TreeNode>> children;	// The subdirectories, in order
+
+	int fd = -1;	// Kept open for the children's openat() while there are handles to spare
+	std::atomic<size_t> opening {0U};	 // Children that haven't opened themselves yet
+	int error = 0;
+	Status status = pending;
+};
+
+struct WalkOptions
+{
+	bool show_all = false, reverse = false, one_filesystem = false;
+	SortMode sort_mode = SortMode::name;
+	unsigned int mask = 0U;
+	unsigned int depth = UINT_MAX;	  // Levels of entries under the top directory
+	unsigned int max_handles = 256U;	// Directory descriptors kept open at once
+	unsigned int jobs = 1U;
+};
+
+class TreeWalker
+{
+private:
+	const WalkOptions opts;
+	std::unique_ptr<TreeNode> top;
+	std::atomic<unsigned int> handles;
+	dev_t device;
+	std::mutex done_lock;
+	std::condition_variable done;
+	StealingPool<TreeNode*> pool;
+
+	void finish(TreeNode& node, const TreeNode::Status status)
+	{
+		{
+			std::lock_guard<std::mutex> guard(done_lock);
+			node.status = status;
+		}
+		done.notify_all();
+	}
+
+	void visit(TreeNode& node, const unsigned int worker)
+	{
+		// Relative to the parent when it's still open, the whole path otherwise
+		TreeNode* parent = node.parent;
+		const bool relative = parent && parent->fd >= 0;
+		DirScanner scanner(relative ? parent->fd : AT_FDCWD,
+						   relative ? node.path.substr(node.name) : node.path,
+						   32U * 1024U);
+		const int error = scanner.error();
+		if(parent && --parent->opening == 0U && parent->fd >= 0)
+		{
+			close(parent->fd);
+			--handles;
+		}
+
+		if(!scanner.good())
+		{
+			node.error = error;
+			// O_NOFOLLOW, links to directories are listed but not walked into
+			finish(node, error == ELOOP || error == ENOTDIR ? TreeNode::skipped : TreeNode::failed);
+			return;
+		}
+		struct stat info;
+		if(opts.one_filesystem && parent && fstat(scanner.dirfd(), &info) == 0 &&
+		   info.st_dev != device)
+		{
+			finish(node, TreeNode::skipped);
+			return;
+		}
+
+		while(scanner.batch([&](const RawEntry* entry) {
+			if(opts.show_all || entry->d_name[0] != '.')
+				node.table.add(entry->d_name, entry->d_type);
+		}))
+			;
+		if(scanner.error())
+		{
+			node.error = scanner.error();
+			finish(node, TreeNode::failed);
+			return;
+		}
+		// Directories are already being read in parallel, one thread and plain statx each
+		node.table.fetchMeta(IoMode::sync, 1U, scanner.dirfd(), opts.mask);
+		node.order = sortTable(node.table, opts.sort_mode, opts.reverse);
+
+		if(node.depth + 1U < opts.depth)
+			for(const uint32_t i: node.order)
+				if(node.table.isDir(i))
+				{
+					TreeNode* child = new TreeNode;
+					child->path = node.path;
+					if(child->path.back() != '/')
+						child->path.push_back('/');
+					child->name = child->path.size();
+					child->path.append(node.table.name(i));
+					child->entry = i;
+					child->depth = node.depth + 1U;
+					child->parent = &node;
+					node.children.emplace_back(child);
+				}
+		node.opening = node.children.size();
+		if(!node.children.empty())
+		{
+			if(handles++ < opts.max_handles)
+				node.fd = scanner.release();
+			else
+				--handles;
+		}
+
+		finish(node, TreeNode::listed);
+		// Backwards, the worker's own deque is last in first out
+		for(size_t i = node.children.size(); i-- > 0U;)
+			pool.push(worker, node.children[i].get());
+	}
+
+public:
+	TreeWalker(const std::string& path, const WalkOptions& options) :
+		opts(options), top(new TreeNode), handles(0U), device(0), pool(options.jobs)
+	{
+		struct stat info;
+		if(opts.one_filesystem && stat(path.c_str(), &info) == 0)
+			device = info.st_dev;
+		top->path = path;
+		pool.push(0U, top.get());
+		pool.start([this](TreeNode* node, const unsigned int worker) { visit(*node, worker); });
+	}
+	TreeWalker(const TreeWalker&) = delete;
+	TreeWalker& operator=(const TreeWalker&) = delete;
+	~TreeWalker() { pool.join(); }
+
+	TreeNode& root() { return *top; }
+
+	// Blocks until `node` has been read
+	TreeNode::Status wait(TreeNode& node)
+	{
+		std::unique_lock<std::mutex> lock(done_lock);
+		done.wait(lock, [&]() { return node.status != TreeNode::pending; });
+		return node.status;
+	}
+};
+
+#endif
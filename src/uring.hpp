@@ -0,0 +1,280 @@
+#ifndef URING_HPP
+#define URING_HPP
+
+// io_uring backend for the metadata pass, keeps a few hundred IORING_OP_STATX requests in
+// flight instead of waiting out every round trip one by one. Talks to the kernel directly so
+// there's no liburing dependency, and callers fall back to fetchMetaSync() when the kernel
+// doesn't have (or doesn't allow) io_uring
+
+#include "meta.hpp"
+#include "pool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+enum class IoMode
+{
+	sync,
+	uring
+};
+
+class StatxRing
+{
+private:
+	int ring_fd;
+	unsigned int depth;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_size, cq_size, sqes_size;
+	io_uring_sqe* sqes;
+	io_uring_cqe* cqes;
+	unsigned *sq_tail, *sq_mask, *sq_array, *cq_head, *cq_tail, *cq_mask;
+
+	// One in-flight request, the statx buffer has to stay put until its completion arrives
+	struct Slot
+	{
+		size_t index;
+		bool follow;
+		struct statx stx;
+	};
+	std::vector<Slot> slots;
+	std::vector<unsigned int> free_slots;
+
+	void push(const int dirfd, const char* name, const unsigned int flags, const unsigned int mask,
+			  const unsigned int slot)
+	{
+		const unsigned int tail = *sq_tail, index = tail & *sq_mask;
+		io_uring_sqe& sqe = sqes[index];
+		std::memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_STATX;
+		sqe.fd = dirfd;
+		sqe.addr = reinterpret_cast<uint64_t>(name);
+		sqe.len = mask;
+		sqe.off = reinterpret_cast<uint64_t>(&slots[slot].stx);
+		sqe.statx_flags = flags;
+		sqe.user_data = slot;
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1U, __ATOMIC_RELEASE);
+	}
+
+	// Waits out the `submitted` requests the kernel still has, throwing their results away, so
+	// nothing writes into `slots` any more. If even that fails the slots are never freed
+	void drain(unsigned int submitted)
+	{
+		while(submitted > 0U)
+		{
+			const long ret =
+				syscall(__NR_io_uring_enter, ring_fd, 0U, 1U, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if(ret < 0 && errno != EINTR)
+			{
+				static_cast<void>(new std::vector<Slot>(std::move(slots)));
+				return;
+			}
+			unsigned int head = *cq_head;
+			const unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+			for(; head != tail && submitted > 0U; ++head, --submitted)
+				free_slots.push_back(cqes[head & *cq_mask].user_data);
+			__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		}
+	}
+
+public:
+	explicit StatxRing(const unsigned int entries = 256U) :
+		ring_fd(-1),
+		depth(0U),
+		sq_ptr(MAP_FAILED),
+		cq_ptr(MAP_FAILED),
+		sq_size(0U),
+		cq_size(0U),
+		sqes_size(0U),
+		sqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+	{
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+		if(ring_fd < 0)
+			return;
+
+		sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if(single_mmap)
+			sq_size = cq_size = std::max(sq_size, cq_size);
+
+		sq_ptr = mmap(nullptr,
+					  sq_size,
+					  PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE,
+					  ring_fd,
+					  IORING_OFF_SQ_RING);
+		if(sq_ptr == MAP_FAILED)
+			return;
+		cq_ptr = single_mmap ? sq_ptr
+							 : mmap(nullptr,
+									cq_size,
+									PROT_READ | PROT_WRITE,
+									MAP_SHARED | MAP_POPULATE,
+									ring_fd,
+									IORING_OFF_CQ_RING);
+		if(cq_ptr == MAP_FAILED)
+			return;
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*>(mmap(nullptr,
+											   sqes_size,
+											   PROT_READ | PROT_WRITE,
+											   MAP_SHARED | MAP_POPULATE,
+											   ring_fd,
+											   IORING_OFF_SQES));
+		if(sqes == MAP_FAILED)
+			return;
+
+		char* sq = static_cast<char*>(sq_ptr);
+		char* cq = static_cast<char*>(cq_ptr);
+		sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		depth = params.sq_entries;
+		slots.resize(depth);
+		for(unsigned int i = depth; i > 0U; --i)
+			free_slots.push_back(i - 1U);
+	}
+	StatxRing(const StatxRing&) = delete;
+	StatxRing& operator=(const StatxRing&) = delete;
+	~StatxRing()
+	{
+		if(sqes != MAP_FAILED)
+			munmap(sqes, sqes_size);
+		if(cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+			munmap(cq_ptr, cq_size);
+		if(sq_ptr != MAP_FAILED)
+			munmap(sq_ptr, sq_size);
+		if(ring_fd >= 0)
+			close(ring_fd);
+	}
+
+	bool good() const { return depth > 0U; }
+
+	// Same contract as fetchMetaSync(), symlinks get a second, following, statx queued as soon
+	// as the first one comes back. Returns false if the ring stopped working, in which case
+	// the caller should redo the whole pass synchronously
+	template<typename Name, typename Meta>
+	bool fetchMeta(int dirfd, const size_t count, const unsigned int mask, Name&& name, Meta&& meta)
+	{
+		if(!good())
+			return false;
+
+		// Links whose target still needs a statx, with their own result kept aside
+		std::vector<std::pair<size_t, struct statx>> links;
+		size_t next = 0U, next_link = 0U;
+		unsigned int in_flight = 0U, unsubmitted = 0U;
+		while(next < count || next_link < links.size() || in_flight > 0U)
+		{
+			unsigned int queued = 0U;
+			while(!free_slots.empty() && next_link < links.size())
+			{
+				const unsigned int slot = free_slots.back();
+				free_slots.pop_back();
+				slots[slot].index = next_link;
+				slots[slot].follow = true;
+				push(dirfd,
+					 name(links[next_link].first),
+					 AT_NO_AUTOMOUNT,
+					 STATX_TYPE | STATX_SIZE,
+					 slot);
+				++next_link;
+				++queued;
+			}
+			while(!free_slots.empty() && next < count)
+			{
+				const char* file = name(next);
+				if(file)
+				{
+					const unsigned int slot = free_slots.back();
+					free_slots.pop_back();
+					slots[slot].index = next;
+					slots[slot].follow = false;
+					push(dirfd, file, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask | STATX_TYPE, slot);
+					++queued;
+				}
+				++next;
+			}
+			in_flight += queued;
+			unsubmitted += queued;
+			if(in_flight == 0U)
+				continue;
+
+			const long ret = syscall(
+				__NR_io_uring_enter, ring_fd, unsubmitted, 1U, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if(ret >= 0)
+				unsubmitted -= ret;
+			else if(errno != EINTR)
+			{
+				// What was submitted can still complete, into the slots the destructor frees
+				drain(in_flight - unsubmitted);
+				return false;
+			}
+
+			unsigned int head = *cq_head;
+			const unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+			for(; head != tail; ++head)
+			{
+				const io_uring_cqe& cqe = cqes[head & *cq_mask];
+				Slot& slot = slots[cqe.user_data];
+				if(slot.follow)
+				{
+					auto& link = links[slot.index];
+					fillMeta(link.second, cqe.res == 0 ? &slot.stx : nullptr, meta(link.first));
+				}
+				else if(cqe.res == 0)
+				{
+					if(S_ISLNK(slot.stx.stx_mode))
+						links.emplace_back(slot.index, slot.stx);
+					else
+						fillMeta(slot.stx, nullptr, meta(slot.index));
+				}
+				// Older kernels don't know IORING_OP_STATX, do those the old way
+				else if(cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)
+					::fetchMeta(dirfd, name(slot.index), mask, meta(slot.index));
+
+				free_slots.push_back(cqe.user_data);
+				--in_flight;
+			}
+			__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		}
+		return true;
+	}
+};
+
+// Metadata pass with the requested backend on `jobs` threads, each with its own ring when
+// using uring. uring quietly becomes sync when it isn't there
+template<typename Name, typename Meta>
+void fetchMetaAll(const IoMode mode, const unsigned int jobs, int dirfd, const size_t count,
+				  const unsigned int mask, Name&& name, Meta&& meta)
+{
+	// A ring per chunk isn't free, so with uring every thread gets one big slice instead
+	const size_t chunk =
+		mode == IoMode::uring ? std::max<size_t>((count + jobs - 1U) / jobs, 256U) : 256U;
+	parallelChunks(jobs, count, chunk, [&](const size_t begin, const size_t end) {
+		auto chunk_name = [&](size_t i) { return name(begin + i); };
+		auto chunk_meta = [&](size_t i) -> FileMeta& { return meta(begin + i); };
+		if(mode == IoMode::uring)
+		{
+			StatxRing ring;
+			if(ring.fetchMeta(dirfd, end - begin, mask, chunk_name, chunk_meta))
+				return;
+		}
+		fetchMetaSync(dirfd, end - begin, mask, chunk_name, chunk_meta);
+	});
+}
+
+#endif
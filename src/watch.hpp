@@ -0,0 +1,539 @@
+#ifndef WATCH_HPP
+#define WATCH_HPP
+
+// --watch, one directory kept on screen and up to date. It's read and statted once, after that
+// inotify says which names changed and only those are statted again. The table, the sort keys
+// and the order are updated in place, and on a terminal the lines of -l and -1 that moved are
+// shifted with insert/delete line escapes, so only new and changed lines get printed again.
+// Anything else (the grid, a column getting wider, more changes than there are lines) redraws
+// the whole listing, from memory, without reading the directory again
+
+#include "idcache.hpp"
+#include "meta.hpp"
+#include "output.hpp"
+#include "render.hpp"
+#include "scan.hpp"
+#include "sortkey.hpp"
+#include "table.hpp"
+#include "theme.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+inline volatile sig_atomic_t watch_stopped = 0, watch_resized = 0;
+
+class Watcher
+{
+private:
+	// What a line of the screen holds besides an entry
+	static constexpr uint32_t BLANK = UINT32_MAX, STALE = UINT32_MAX - 1U;
+
+	// How the order changed, replayed on the screen once the whole batch is in
+	struct Change
+	{
+		enum Kind : uint8_t
+		{
+			insert,
+			erase,
+			update
+		} kind;
+		size_t at;
+	};
+
+	const std::string directory;
+	const Options& opts;
+	IdCache& ids;
+	const Theme& theme;
+	const unsigned int mask;
+	const bool tty, by_line;	// Line by line updates for -l and -1 on a terminal
+	// Only open while a batch is looked at, an open descriptor would hold back IN_DELETE_SELF
+	int dirfd, notify;
+
+	EntryTable table;
+	std::vector<SortKey> keys;	  // By entry, key.offset is into `folded`
+	std::string folded;
+	std::vector<bool> live;
+	size_t dead;
+	std::unordered_map<std::string, uint32_t> entries;	  // The live ones by name
+	std::vector<uint32_t> order;
+
+	Summary summary;
+	bool wider;	   // Something doesn't fit the columns on the screen anymore
+	std::vector<Change> changes;
+	std::vector<uint32_t> screen;	 // What each line under the header shows
+	unsigned short width, height;
+
+	bool before(const uint32_t a, const uint32_t b) const
+	{
+		return entryLess(opts.sort_mode,
+						 opts.reverse,
+						 keys[a],
+						 folded.data() + keys[a].offset,
+						 keys[b],
+						 folded.data() + keys[b].offset,
+						 [&](const SortKey& key) { return table.cName(key.index); });
+	}
+
+	void sortKey(const uint32_t i)
+	{
+		static const FileMeta no_meta;
+		fillKey(keys[i],
+				opts.sort_mode,
+				table.name(i),
+				folded.data() + keys[i].offset,
+				table.isDir(i),
+				table.hasMeta() ? table.meta(i) : no_meta);
+	}
+
+	// The key and the name lookup for entry `i`, which was just added to the table
+	void track(const uint32_t i)
+	{
+		keys.emplace_back();
+		keys[i].offset = folded.size();
+		keys[i].index = i;
+		for(const char letter: table.name(i))
+			folded.push_back(foldCase(letter));
+		sortKey(i);
+		live.push_back(true);
+		entries.emplace(table.name(i), i);
+	}
+
+	// Where entry `i` is in the order, -U has nothing to search by
+	size_t position(const uint32_t i) const
+	{
+		auto found = order.begin();
+		if(opts.sort_mode != SortMode::none)
+			found = std::lower_bound(order.begin(), order.end(), i, [&](uint32_t a, uint32_t b) {
+				return before(a, b);
+			});
+		return std::find(found, order.end(), i) - order.begin();
+	}
+
+	void widen(const uint32_t i)
+	{
+		if(opts.long_list)
+			wider = wider || digitCount(table.meta(i).size) > digitCount(summary.largest_size) ||
+					ids.user(table.meta(i).uid).length() > summary.user_width ||
+					ids.group(table.meta(i).gid).length() > summary.group_width;
+	}
+
+	void insert(const uint32_t i)
+	{
+		const size_t at =
+			opts.sort_mode == SortMode::none
+				? order.size()
+				: std::upper_bound(order.begin(),
+								   order.end(),
+								   i,
+								   [&](uint32_t a, uint32_t b) { return before(a, b); }) -
+					  order.begin();
+		order.insert(order.begin() + at, i);
+		changes.push_back({Change::insert, at});
+		widen(i);
+	}
+
+	void erase(const size_t at)
+	{
+		order.erase(order.begin() + at);
+		changes.push_back({Change::erase, at});
+	}
+
+	void add(const std::string& name, const FileMeta& meta)
+	{
+		const uint32_t i = table.size();
+		// Links to directories are listed as directories
+		table.add(name, meta.is_dir ? uint8_t(DT_DIR) : uint8_t(IFTODT(meta.mode)));
+		if(mask)
+			table.setMeta(i, meta);
+		track(i);
+		insert(i);
+	}
+
+	// Brings one name in line with the directory, whatever happened to it since
+	void refresh(const std::string& name)
+	{
+		FileMeta meta;
+		const bool exists = fetchMeta(dirfd, name.c_str(), mask, meta);
+		const auto found = entries.find(name);
+		if(found == entries.end())
+		{
+			if(exists)
+				add(name, meta);
+			return;
+		}
+
+		const uint32_t i = found->second;
+		const size_t at = position(i);
+		// Same kind of entry, only its metadata changed (the grid doesn't show any)
+		if(exists && meta.is_dir == table.isDir(i))
+		{
+			if(!mask)
+				return;
+			const uint64_t primary = keys[i].primary;
+			table.setMeta(i, meta);
+			sortKey(i);
+			if(keys[i].primary == primary)
+			{
+				changes.push_back({Change::update, at});
+				widen(i);
+			}
+			else
+			{
+				erase(at);
+				insert(i);
+			}
+			return;
+		}
+
+		erase(at);
+		live[i] = false;
+		++dead;
+		entries.erase(found);
+		if(exists)
+			add(name, meta);
+	}
+
+	// Everything from scratch, at the start and when inotify lost track. Returns errno if the
+	// directory couldn't be read, 0 if it could
+	int load()
+	{
+		table = EntryTable();
+		keys.clear();
+		folded.clear();
+		live.clear();
+		entries.clear();
+		dead = 0U;
+		DirScanner scanner(directory);
+		while(scanner.batch([&](const RawEntry* entry) {
+			if(opts.show_all || entry->d_name[0] != '.')
+				table.add(entry->d_name, entry->d_type);
+		}))
+			;
+		if(!scanner.good())
+			return scanner.error();
+		table.fetchMeta(opts.io_mode, opts.jobs, scanner.dirfd(), mask);
+		order.resize(table.size());
+		for(uint32_t i = 0U; i < table.size(); ++i)
+		{
+			track(i);
+			order[i] = i;
+		}
+		if(opts.sort_mode != SortMode::none)
+			std::sort(
+				order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return before(a, b); });
+		return 0;
+	}
+
+	// Drops the entries that are gone, which renumbers all the others
+	void compact()
+	{
+		EntryTable kept;
+		std::vector<uint32_t> renumbered(table.size(), BLANK);
+		for(uint32_t i = 0U; i < table.size(); ++i)
+			if(live[i])
+			{
+				renumbered[i] = kept.size();
+				kept.add(table.name(i), table.type(i));
+				if(table.hasMeta())
+					kept.setMeta(kept.size() - 1U, table.meta(i));
+			}
+		table = std::move(kept);
+		keys.clear();
+		folded.clear();
+		live.clear();
+		entries.clear();
+		dead = 0U;
+		for(uint32_t i = 0U; i < table.size(); ++i)
+			track(i);
+		for(uint32_t& i: order)
+			i = renumbered[i];
+		for(uint32_t& line: screen)
+			line = line < BLANK - 1U ? renumbered[line] : line;
+	}
+
+	void header(OutBuf& out)
+	{
+		out.append("    ", 4U)
+			.append(theme[DIRECTORY])
+			.append(directory)
+			.append(theme[RESET])
+			.append("  ", 2U)
+			.number(order.size())
+			.append(order.size() == 1U ? " entry" : " entries");
+	}
+
+	// Lines for entries, the header takes the first and the last is kept empty
+	size_t lines() const { return height > 2U ? height - 2U : 0U; }
+
+	// The cursor to line `line` (from 0) of the screen, which is then cleared
+	void moveTo(OutBuf& out, const size_t line, const bool clear = true)
+	{
+		out.append("\033[", 2U).number(line + 1U).append(";1H", 3U);
+		if(clear)
+			out.append("\033[2K", 4U);
+	}
+
+	// The whole listing again, widths worked out anew
+	void redraw(OutBuf& out)
+	{
+		if(dead)
+			compact();
+		changes.clear();
+		wider = false;
+		summary = Summary();
+		summary.addNames(table);
+		summary.addMeta(table, ids, opts.long_list);
+		winsize size {};
+		if(tty && ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col)
+		{
+			width = size.ws_col;
+			height = size.ws_row;
+		}
+
+		if(tty)
+			out.append("\033[H\033[2J", 7U);
+		header(out);
+		out.put('\n');
+		Printer printer(out, theme, ids, opts, summary, width);
+		// The line under the last one stays empty, a newline there would scroll the screen
+		const size_t count = by_line ? std::min(order.size(), lines()) : order.size();
+		screen.assign(order.begin(), order.begin() + count);
+		if(by_line)
+			for(size_t k = 0U; k < count; ++k)
+				printer.print(File(table, order[k]));
+		else
+			printer.print(table, order);
+		printer.finish();
+		if(!tty)
+			out.put('\n');
+	}
+
+	// Shifts the lines the changes moved and prints the ones that are new or changed
+	void update(OutBuf& out)
+	{
+		const size_t lines = this->lines();
+		if(!by_line || wider || changes.size() > lines)
+		{
+			redraw(out);
+			return;
+		}
+
+		screen.resize(lines, BLANK);
+		for(const Change& change: changes)
+		{
+			if(change.at >= lines)
+				continue;
+			moveTo(out, change.at + 1U, false);
+			if(change.kind == Change::insert)
+			{
+				// The line pushed off the bottom lands on the spare one, which is cleared again
+				out.append("\033[L", 3U);
+				moveTo(out, lines + 1U);
+				screen.insert(screen.begin() + change.at, STALE);
+				screen.pop_back();
+			}
+			else if(change.kind == Change::erase)
+			{
+				out.append("\033[M", 3U);
+				screen.erase(screen.begin() + change.at);
+				screen.push_back(BLANK);
+			}
+			else
+				screen[change.at] = STALE;
+		}
+		changes.clear();
+
+		Printer printer(out, theme, ids, opts, summary, width);
+		for(size_t k = 0U; k < lines; ++k)
+		{
+			const uint32_t want = k < order.size() ? order[k] : BLANK;
+			if(screen[k] == want)
+				continue;
+			moveTo(out, k + 1U);
+			if(want != BLANK)
+				printer.print(File(table, want));
+			screen[k] = want;
+		}
+		moveTo(out, 0U);
+		header(out);
+		moveTo(out, lines + 1U, false);
+		if(dead > order.size())
+			compact();
+	}
+
+public:
+	Watcher(const std::string& path, const Options& options, IdCache& id_cache,
+			const Theme& colors) :
+		directory(path),
+		opts(options),
+		ids(id_cache),
+		theme(colors),
+		mask(metaMask(options.long_list) | sortMask(options.sort_mode)),
+		tty(isatty(STDOUT_FILENO)),
+		by_line(tty && (options.long_list || options.one_line)),
+		dirfd(-1),
+		notify(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+		dead(0U),
+		wider(false),
+		width(80U),
+		height(24U)
+	{
+	}
+	Watcher(const Watcher&) = delete;
+	Watcher& operator=(const Watcher&) = delete;
+	~Watcher()
+	{
+		if(notify >= 0)
+			close(notify);
+	}
+
+	// Until Ctrl-C (0), the directory is gone (3) or can't be read (2)
+	int run()
+	{
+		// Names only need to be looked at again when they come or go, unless their metadata is
+		// on the screen or sorted by
+		const uint32_t events = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+								IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK |
+								(mask ? IN_MODIFY | IN_ATTRIB : 0U);
+		// Watched before it's read, so nothing that happens in between is missed
+		if(notify < 0 || inotify_add_watch(notify, directory.c_str(), events) < 0)
+		{
+			OutBuf out;
+			out.append("    ", 4U)
+				.append(theme[ERROR])
+				.append("Couldn't watch: ")
+				.append(std::strerror(errno))
+				.append(theme[RESET])
+				.put('\n');
+			return 2;
+		}
+
+		struct sigaction action {};
+		action.sa_handler = [](int signal) {
+			if(signal == SIGWINCH)
+				watch_resized = 1;
+			else
+				watch_stopped = 1;
+		};
+		sigaction(SIGINT, &action, nullptr);
+		sigaction(SIGTERM, &action, nullptr);
+		sigaction(SIGWINCH, &action, nullptr);
+		// Only let through while waiting, so none of them slips in between a check and the wait
+		sigset_t blocked, waiting;
+		sigemptyset(&blocked);
+		sigaddset(&blocked, SIGINT);
+		sigaddset(&blocked, SIGTERM);
+		sigaddset(&blocked, SIGWINCH);
+		sigprocmask(SIG_BLOCK, &blocked, &waiting);
+
+		OutBuf out;
+		int error = load();
+		if(error)
+		{
+			sigprocmask(SIG_SETMASK, &waiting, nullptr);
+			out.append("    ", 4U)
+				.append(theme[ERROR])
+				.append("Couldn't open: ")
+				.append(std::strerror(error))
+				.append(theme[RESET])
+				.put('\n');
+			return 2;
+		}
+		// No wrapping, a line that's too long is cut off instead of moving every line under it
+		if(tty)
+			out.append("\033[?7l\033[?25l", 11U);
+		redraw(out);
+		out.flush();
+
+		std::unique_ptr<char[]> buffer(new char[64U * 1024U]);
+		std::vector<std::string> dirty;
+		std::unordered_set<std::string> pending;
+		bool gone = false, lost = false;
+		auto drain = [&]() {
+			ssize_t got;
+			while((got = read(notify, buffer.get(), 64U * 1024U)) > 0)
+				for(const char* at = buffer.get(); at < buffer.get() + got;)
+				{
+					const inotify_event* event = reinterpret_cast<const inotify_event*>(at);
+					at += sizeof(inotify_event) + event->len;
+					gone = gone || (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED));
+					lost = lost || (event->mask & IN_Q_OVERFLOW);
+					if(event->len && (opts.show_all || event->name[0] != '.') &&
+					   pending.emplace(event->name).second)
+						dirty.emplace_back(event->name);
+				}
+		};
+
+		pollfd wait {notify, POLLIN, 0};
+		while(!watch_stopped && !gone && !error)
+		{
+			if(watch_resized)
+			{
+				watch_resized = 0;
+				redraw(out);
+				out.flush();
+			}
+			if(ppoll(&wait, 1, nullptr, &waiting) <= 0)
+				continue;
+			// A burst (an archive being unpacked) is taken in as one update, up to 100ms of it
+			drain();
+			for(int round = 0; round < 5 && poll(&wait, 1, 20) > 0; ++round)
+				drain();
+
+			if(lost)
+			{
+				if((error = load()) != 0)
+					break;
+				redraw(out);
+				lost = false;
+			}
+			else if(!dirty.empty() &&
+					(dirfd = open(directory.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC)) >= 0)
+			{
+				for(const std::string& name: dirty)
+					refresh(name);
+				close(dirfd);
+				update(out);
+			}
+			dirty.clear();
+			pending.clear();
+			out.flush();
+		}
+
+		sigprocmask(SIG_SETMASK, &waiting, nullptr);
+		if(tty)
+		{
+			moveTo(out, height - 1U, false);
+			out.append("\033[?7h\033[?25h", 11U);
+		}
+		if(gone)
+			out.append("    ", 4U)
+				.append(theme[ERROR])
+				.append("The directory is gone. ")
+				.append(theme[RESET])
+				.put('\n');
+		else if(error)
+			out.append("    ", 4U)
+				.append(theme[ERROR])
+				.append("Couldn't read: ")
+				.append(std::strerror(error))
+				.append(theme[RESET])
+				.put('\n');
+		return gone ? 3 : error ? 2 : 0;
+	}
+};
+
+#endif
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+# Generates width.hpp's zero_width and double_width tables, `python3 width_tables.py width.hpp`
+# rewrites them in place. The widths are glibc's (localedata/unicode-gen/utf8_gen.py), from
+# UnicodeData.txt and EastAsianWidth.txt as Python's unicodedata has them, so run it with a
+# Python whose unicodedata.unidata_version is the Unicode the header names:
+#
+#	zero	Mn, Me and Cf, the Hangul medial and final jamo (U+1160-11FF, U+D7B0-D7FF)
+#	double	East Asian Wide and Fullwidth, and U+3248-324F and U+4DC0-4DFF (Ambiguous and
+#			Neutral, but drawn wide)
+#	one		everything else, the Prepended_Concatenation_Mark format characters (U+0600-0605
+#			and the like, which are drawn) among them
+#
+# Unassigned code points aren't in either table, a terminal gives them one column
+
+import re
+import sys
+import unicodedata
+
+# Prepended_Concatenation_Mark from PropList.txt, which unicodedata doesn't carry
+prepended = [(0x600, 0x605), (0x6DD, 0x6DD), (0x70F, 0x70F), (0x890, 0x891), (0x8E2, 0x8E2),
+			 (0x110BD, 0x110BD), (0x110CD, 0x110CD)]
+
+
+def width(code):
+	char = chr(code)
+	category = unicodedata.category(char)
+	if category == 'Cn':
+		return 1
+	if any(first <= code <= last for first, last in prepended) or code == 0xAD:
+		return 1
+	if 0x1160 <= code <= 0x11FF or 0xD7B0 <= code <= 0xD7FF:
+		return 0
+	if category in ('Mn', 'Me', 'Cf'):
+		return 0
+	if 0x3248 <= code <= 0x324F or 0x4DC0 <= code <= 0x4DFF:
+		return 2
+	return 2 if unicodedata.east_asian_width(char) in ('W', 'F') else 1
+
+
+def ranges(widths, wanted):
+	found = []
+	for code, code_width in enumerate(widths):
+		if code_width != wanted:
+			continue
+		if found and found[-1][1] == code - 1:
+			found[-1][1] = code
+		else:
+			found.append([code, code])
+	return found
+
+
+# Rows of ranges in a tab-indented block of at most 100 columns
+def table(found):
+	rows, row = [], ''
+	for first, last in found:
+		item = '{0x%X, 0x%X},' % (first, last)
+		if row and 4 + len(row) + 1 + len(item) > 100:
+			rows.append(row)
+			row = ''
+		row = row + ' ' + item if row else item
+	rows.append(row)
+	return ''.join('\t' + row + '\n' for row in rows)
+
+
+def main():
+	if len(sys.argv) != 2:
+		sys.exit('Usage: width_tables.py width.hpp')
+	widths = [width(code) for code in range(0x110000)]
+	# codeWidth() doesn't look below U+0300
+	if any(code_width != 1 for code_width in widths[:0x300]):
+		sys.exit('A code point below U+0300 isn\'t one column wide')
+
+	with open(sys.argv[1]) as header:
+		text = header.read()
+	for name, wanted in (('zero_width', 0), ('double_width', 2)):
+		text, count = re.subn(r'(constexpr CodeRange %s\[\] = \{\n).*?(^\};)' % name,
+							  lambda match: match.group(1) + table(ranges(widths, wanted)) +
+							  match.group(2),
+							  text,
+							  flags=re.S | re.M)
+		if count != 1:
+			sys.exit('No %s table in %s' % (name, sys.argv[1]))
+	text = re.sub(r'generated from Unicode [0-9.]+',
+				  'generated from Unicode ' + unicodedata.unidata_version.split('.')[0],
+				  text)
+	with open(sys.argv[1], 'w') as header:
+		header.write(text)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,33 @@
+// codeWidth() against glibc's wcwidth() in C.UTF-8 over the Basic Multilingual Plane, run by
+// `make test`. Both come from Unicode 14 (glibc 2.35 to 2.37), with another glibc the tables
+// have to be generated again by width_tables.py first. Where wcwidth() has no width, for
+// unassigned code points, controls and surrogates, codeWidth() has to give one column
+
+#include "width.hpp"
+
+#include <clocale>
+#include <cstdio>
+#include <cwchar>
+
+int main()
+{
+	if(!std::setlocale(LC_CTYPE, "C.UTF-8"))
+	{
+		std::fprintf(stderr, "width_test: no C.UTF-8 locale\n");
+		return 2;
+	}
+	int failures = 0;
+	// From U+0001, a name can't hold U+0000
+	for(char32_t code = 1U; code < 0x10000U; ++code)
+	{
+		const int expected = wcwidth(static_cast<wchar_t>(code));
+		const unsigned int width = codeWidth(code);
+		if(expected < 0 ? width != 1U : width != static_cast<unsigned int>(expected))
+			if(++failures <= 20)
+				std::fprintf(
+					stderr, "U+%04X: %u columns, wcwidth %d\n", unsigned(code), width, expected);
+	}
+	if(failures)
+		std::fprintf(stderr, "width_test: %d failures\n", failures);
+	return failures ? 1 : 0;
+}